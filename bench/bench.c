@@ -0,0 +1,289 @@
+/* Microbenchmarks for the board engine, history and save files.
+ * Prints one CSV line per benchmark to stdout */
+
+#include "board.h"
+#include "common.h"
+#include "history.h"
+#include "rng.h"
+#include "save.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CORPUS_SIZE 4096
+#define RUNS 15
+#define SEED 2048
+
+typedef struct corpus {
+  Board boards[CORPUS_SIZE];
+  int size;
+} Corpus;
+
+/* Runs 'fn' over the corpus, returns ops done */
+typedef long (*BenchFn)(const Corpus *corpus, int arg);
+
+static volatile long sink; /* keeps results alive */
+static const char *dir_names[] = {"up", "down", "left", "right"};
+
+static void build_corpus(Corpus *corpus, int size);
+static void bench(const char *name, const char *variant, const Corpus *corpus,
+                  BenchFn fn, int arg);
+static double now_ns(void);
+static long bench_slide(const Corpus *corpus, int dir);
+static long bench_slide_moves(const Corpus *corpus, int dir);
+static long bench_can_slide(const Corpus *corpus, int arg);
+static long bench_add_tile(const Corpus *corpus, int arg);
+static long bench_history_save(const Corpus *corpus, int arg);
+static long bench_history_moves(const Corpus *corpus, int arg);
+static long bench_save_load(const Corpus *corpus, int arg);
+static long bench_load(const Corpus *corpus, int arg);
+static long bench_list_slots(const Corpus *corpus, int arg);
+
+int main(void) {
+  static Corpus corpus;
+  char home[] = "/tmp/2048-bench-XXXXXX";
+
+  /* keep save files away from the real ones */
+  if (!mkdtemp(home) || setenv("HOME", home, 1) != 0) {
+    perror("bench");
+    return 1;
+  }
+
+  printf("benchmark,variant,size,ns_per_op,ns_stddev,ops_per_sec,runs\n");
+  for (int size = MIN_BOARD_SIZE; size <= MAX_BOARD_SIZE; size++) {
+    build_corpus(&corpus, size);
+    for (Dir d = UP; d <= RIGHT; d++) {
+      bench("board_slide", dir_names[d], &corpus, bench_slide, d);
+      bench("board_slide_moves", dir_names[d], &corpus, bench_slide_moves, d);
+    }
+    bench("board_can_slide", "", &corpus, bench_can_slide, 0);
+    bench("board_add_tile", "", &corpus, bench_add_tile, 0);
+    bench("history_save_state", "", &corpus, bench_history_save, 0);
+    bench("history_move_undo_redo", "", &corpus, bench_history_moves, 0);
+    bench("save_load_slot", "", &corpus, bench_save_load, 0);
+    bench("load_slot", "long_history", &corpus, bench_load, 0);
+    bench("list_save_slots", "", &corpus, bench_list_slots, 0);
+  }
+
+  delete_save_slot(0);
+  char dir[sizeof(home) + 16], index[sizeof(dir) + 8];
+  snprintf(dir, sizeof(dir), "%s/.2048_saves", home);
+  snprintf(index, sizeof(index), "%s/index", dir);
+  unlink(index);
+  rmdir(dir);
+  rmdir(home);
+  return 0;
+}
+
+/* Boards seen while playing random games from a fixed seed */
+static void build_corpus(Corpus *corpus, int size) {
+  Rng rng;
+  Board board;
+  int n = 0;
+
+  rng_seed(&rng, SEED + size);
+  corpus->size = size;
+  board_start(&board, size, &rng);
+  while (n < CORPUS_SIZE) {
+    Board new_board;
+    corpus->boards[n++] = board;
+    if (board_slide(&board, &new_board, NULL, rng_below(&rng, 4)) ==
+        NO_SLIDE) {
+      if (!board_can_slide(&board))
+        board_start(&board, size, &rng);
+      continue;
+    }
+    board = new_board;
+    board_add_tile(&board, false, &rng);
+  }
+}
+
+static void bench(const char *name, const char *variant, const Corpus *corpus,
+                  BenchFn fn, int arg) {
+  double ns[RUNS];
+  double mean = 0, var = 0;
+
+  fn(corpus, arg); /* warm up */
+  for (int r = 0; r < RUNS; r++) {
+    double start = now_ns();
+    long ops = fn(corpus, arg);
+    ns[r] = (now_ns() - start) / ops;
+    mean += ns[r];
+  }
+  mean /= RUNS;
+  for (int r = 0; r < RUNS; r++)
+    var += (ns[r] - mean) * (ns[r] - mean);
+  var /= RUNS - 1;
+
+  printf("%s,%s,%d,%.2f,%.2f,%.0f,%d\n", name, variant, corpus->size, mean,
+         sqrt(var), 1e9 / mean, RUNS);
+  fflush(stdout);
+}
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static long bench_slide(const Corpus *corpus, int dir) {
+  long points = 0;
+  for (int i = 0; i < CORPUS_SIZE; i++) {
+    Board new_board;
+    points += board_slide(&corpus->boards[i], &new_board, NULL, dir);
+  }
+  sink = points;
+  return CORPUS_SIZE;
+}
+
+/* With the animation moves, as the interactive game slides */
+static long bench_slide_moves(const Corpus *corpus, int dir) {
+  long points = 0;
+  for (int i = 0; i < CORPUS_SIZE; i++) {
+    Board new_board, moves;
+    points += board_slide(&corpus->boards[i], &new_board, &moves, dir);
+  }
+  sink = points;
+  return CORPUS_SIZE;
+}
+
+static long bench_can_slide(const Corpus *corpus, int arg) {
+  (void)arg;
+  long n = 0;
+  for (int i = 0; i < CORPUS_SIZE; i++)
+    n += board_can_slide(&corpus->boards[i]);
+  sink = n;
+  return CORPUS_SIZE;
+}
+
+static long bench_add_tile(const Corpus *corpus, int arg) {
+  (void)arg;
+  Rng rng;
+  long n = 0;
+
+  rng_seed(&rng, SEED);
+  for (int i = 0; i < CORPUS_SIZE; i++) {
+    Board board = corpus->boards[i];
+    board_add_tile(&board, false, &rng);
+    n += board.tiles[0][0];
+  }
+  sink = n;
+  return CORPUS_SIZE;
+}
+
+static long bench_history_save(const Corpus *corpus, int arg) {
+  (void)arg;
+  static History history;
+  Stats stats = {.board_size = corpus->size};
+
+  history_clear(&history);
+  for (int i = 0; i < CORPUS_SIZE; i++) {
+    stats.score = i;
+    history_save_state(&history, &corpus->boards[i], &stats);
+  }
+  sink = history_undo_count(&history);
+  return CORPUS_SIZE;
+}
+
+/* Record a game's moves, then undo and redo all of them */
+static long bench_history_moves(const Corpus *corpus, int arg) {
+  (void)arg;
+  static History history;
+  Board board;
+  Stats stats = {.board_size = corpus->size};
+  Rng rng;
+  long ops = 0;
+
+  rng_seed(&rng, SEED);
+  history_clear(&history);
+  board_start(&board, corpus->size, &rng);
+  history_save_state(&history, &board, &stats);
+  for (int i = 0; i < CORPUS_SIZE; i++) {
+    Board new_board;
+    Dir dir = rng_below(&rng, 4);
+    stats.points = board_slide(&board, &new_board, NULL, dir);
+    if (stats.points == NO_SLIDE)
+      continue;
+    stats.score += stats.points;
+    board = new_board;
+    Coord tile = board_add_tile(&board, false, &rng);
+    history_save_move(&history, &board, &stats, dir, tile);
+    ops++;
+  }
+  while (history_undo(&history, &board, &stats))
+    ops++;
+  while (history_redo(&history, &board, &stats))
+    ops++;
+  sink = stats.score;
+  return ops;
+}
+
+/* Save and load slot 0 with a full history */
+static long bench_save_load(const Corpus *corpus, int arg) {
+  (void)arg;
+  static History history;
+  Stats stats = {.board_size = corpus->size, .points = NO_SLIDE};
+  Board board;
+  const int ops = 64;
+
+  history_clear(&history);
+  for (int i = 0; i < MAX_HISTORY; i++)
+    history_save_state(&history, &corpus->boards[i], &stats);
+
+  for (int i = 0; i < ops; i++) {
+    /* as after a key that didn't slide, must still load */
+    stats.points = NO_SLIDE;
+    if (save_game_slot(&corpus->boards[i], &stats, &history, 0, "bench") !=
+            0 ||
+        load_game_slot(&board, &stats, &history, 0) != 0) {
+      fprintf(stderr, "bench: save/load failed\n");
+      exit(1);
+    }
+  }
+  sink = board.tiles[0][0];
+  return ops;
+}
+
+/* Load slot 0 holding every corpus board in its history */
+static long bench_load(const Corpus *corpus, int arg) {
+  (void)arg;
+  static History history;
+  Stats stats = {.board_size = corpus->size};
+  Board board;
+  const int ops = 64;
+
+  history_clear(&history);
+  for (int i = 0; i < CORPUS_SIZE; i++)
+    history_save_state(&history, &corpus->boards[i], &stats);
+  if (save_game_slot(&corpus->boards[0], &stats, &history, 0, "bench") != 0) {
+    fprintf(stderr, "bench: save failed\n");
+    exit(1);
+  }
+
+  for (int i = 0; i < ops; i++) {
+    if (load_game_slot(&board, &stats, &history, 0) != 0) {
+      fprintf(stderr, "bench: load failed\n");
+      exit(1);
+    }
+  }
+  sink = board.tiles[0][0];
+  return ops;
+}
+
+/* List the slots as the load menu does, with slot 0 saved */
+static long bench_list_slots(const Corpus *corpus, int arg) {
+  (void)corpus;
+  (void)arg;
+  SlotInfo slots[MAX_SAVE_SLOTS];
+  const int ops = 256;
+  long n = 0;
+
+  for (int i = 0; i < ops; i++)
+    n += list_save_slot_info(slots);
+  sink = n;
+  return ops;
+}
@@ -0,0 +1,226 @@
+/* Rendering benchmark: scripted games drawn through the real draw code
+ * on an off-screen terminal, animations running without pauses.
+ * Prints one CSV line per renderer, scenario and board size */
+
+#include "anim.h"
+#include "board.h"
+#include "common.h"
+#include "draw.h"
+#include "render.h"
+#include "rng.h"
+#include <ncurses.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MOVES 2000
+#define UNDOS 200
+#define REDRAWS 200
+#define SEED 2048
+
+/* Runs a scenario on a board size, returns ops done */
+typedef long (*ScenarioFn)(int size);
+
+static const Renderer *inner; /* renderer being measured */
+static long frames;           /* flushes since the scenario started */
+static FILE *term_out;        /* where the terminal's output goes */
+
+static bool counting_open(const Rect panes[PANES]);
+static void counting_close(void);
+static void counting_put(Pane pane, int y, int x, const chtype *cells,
+                         int n);
+static void counting_flush(Pane pane);
+static void run(const char *scenario, ScenarioFn fn, int size);
+static off_t term_bytes(void);
+static double cpu_ns(void);
+static Dir random_slide(const Board *board, Rng *rng);
+static long play_moves(int size);
+static long play_undos(int size);
+static long redraw(int size);
+
+/* Forwards to 'inner', counting frames */
+static const Renderer counting = {.name = "counting",
+                                  .open = counting_open,
+                                  .close = counting_close,
+                                  .put = counting_put,
+                                  .flush = counting_flush};
+
+int main(void) {
+  static const char *terms[] = {"xterm-256color", "xterm", "vt100"};
+  static const Renderer *renderers[] = {&curses_renderer, &ansi_renderer,
+                                        &null_renderer};
+  FILE *term_in = fopen("/dev/null", "r");
+  SCREEN *screen = NULL;
+
+  term_out = tmpfile();
+  /* big enough for 5x5 boards, whatever the terminal's size */
+  use_env(TRUE);
+  setenv("LINES", "50", 1);
+  setenv("COLUMNS", "132", 1);
+  for (int i = 0; term_out && term_in && !screen &&
+                  i < (int)(sizeof(terms) / sizeof(*terms));
+       i++)
+    screen = newterm(terms[i], term_out, term_in);
+  if (!screen) {
+    fprintf(stderr, "render_bench: can't open an off-screen terminal\n");
+    return 1;
+  }
+  render_set_output(fileno(term_out));
+  anim_set_instant(true);
+  setup_screen();
+
+  printf("renderer,scenario,size,ops,frames,cpu_ns_per_frame,"
+         "bytes_per_frame,bytes_per_op\n");
+  for (int r = 0; r < (int)(sizeof(renderers) / sizeof(*renderers)); r++) {
+    inner = renderers[r];
+    set_renderer(&counting);
+    for (int size = MIN_BOARD_SIZE; size <= MAX_BOARD_SIZE; size++) {
+      run("move", play_moves, size);
+      run("undo", play_undos, size);
+      run("redraw", redraw, size);
+    }
+  }
+
+  endwin();
+  delscreen(screen);
+  return 0;
+}
+
+static bool counting_open(const Rect panes[PANES]) {
+  return inner->open(panes);
+}
+
+static void counting_close(void) { inner->close(); }
+
+static void counting_put(Pane pane, int y, int x, const chtype *cells,
+                         int n) {
+  inner->put(pane, y, x, cells, n);
+}
+
+static void counting_flush(Pane pane) {
+  inner->flush(pane);
+  frames++;
+}
+
+static void run(const char *scenario, ScenarioFn fn, int size) {
+  if (init_win(size) == WIN_TOO_SMALL) {
+    fprintf(stderr, "render_bench: terminal too small for %dx%d\n", size,
+            size);
+    exit(1);
+  }
+
+  frames = 0;
+  off_t start_bytes = term_bytes();
+  double start = cpu_ns();
+  long ops = fn(size);
+  double ns = cpu_ns() - start;
+  off_t bytes = term_bytes() - start_bytes;
+
+  /* keep the output file small */
+  if (ftruncate(fileno(term_out), 0) != 0)
+    perror("render_bench");
+  rewind(term_out);
+
+  printf("%s,%s,%d,%ld,%ld,%.0f,%.1f,%.1f\n", inner->name, scenario, size,
+         ops, frames, ns / frames, (double)bytes / frames,
+         (double)bytes / ops);
+  fflush(stdout);
+}
+
+/* Bytes written to the terminal so far, ncurses' buffered ones too */
+static off_t term_bytes(void) {
+  fflush(term_out);
+  return lseek(fileno(term_out), 0, SEEK_END);
+}
+
+/* CPU time of the process, draw code and terminal output alike */
+static double cpu_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* A direction that slides, or UP if none does */
+static Dir random_slide(const Board *board, Rng *rng) {
+  Board new_board;
+  for (int tries = 0; tries < 16; tries++) {
+    Dir dir = rng_below(rng, 4);
+    if (board_slide(board, &new_board, NULL, dir) != NO_SLIDE)
+      return dir;
+  }
+  return UP;
+}
+
+/* Moves as the game draws them: points, slide, result, spawned tile */
+static long play_moves(int size) {
+  Board board, new_board, moves;
+  Stats stats = {.board_size = size, .auto_save = true};
+  Rng rng;
+
+  rng_seed(&rng, SEED + size);
+  board_start(&board, size, &rng);
+  draw(&board, &stats);
+  for (int i = 0; i < MOVES; i++) {
+    Dir dir = random_slide(&board, &rng);
+    stats.points = board_slide(&board, &new_board, &moves, dir);
+    if (stats.points == NO_SLIDE) {
+      board_start(&board, size, &rng);
+      stats.score = 0;
+      draw(&board, &stats);
+      continue;
+    }
+
+    draw(NULL, &stats);
+    draw_slide(&board, &moves, dir);
+    board = new_board;
+    stats.score += stats.points;
+    if (stats.score > stats.max_score)
+      stats.max_score = stats.score;
+    draw(&board, &stats);
+    board_add_tile(&board, false, &rng);
+    draw(&board, NULL);
+  }
+  return MOVES;
+}
+
+/* Undo and redo animations between consecutive boards of a game */
+static long play_undos(int size) {
+  Board board, new_board;
+  Stats stats = {.board_size = size, .auto_save = true};
+  Rng rng;
+
+  rng_seed(&rng, SEED + size);
+  board_start(&board, size, &rng);
+  draw(&board, &stats);
+  for (int i = 0; i < UNDOS; i++) {
+    Dir dir = random_slide(&board, &rng);
+    if (board_slide(&board, &new_board, NULL, dir) == NO_SLIDE) {
+      board_start(&new_board, size, &rng);
+    } else {
+      board_add_tile(&new_board, false, &rng);
+    }
+
+    draw_undo_redo(&new_board, &board, true);
+    draw(&board, &stats);
+    draw_undo_redo(&board, &new_board, false);
+    draw(&new_board, &stats);
+    board = new_board;
+  }
+  return UNDOS;
+}
+
+/* The whole screen again, as after a resize or a menu */
+static long redraw(int size) {
+  Board board;
+  Stats stats = {.board_size = size, .auto_save = true};
+  Rng rng;
+
+  rng_seed(&rng, SEED + size);
+  board_start(&board, size, &rng);
+  for (int i = 0; i < REDRAWS; i++) {
+    init_win(size);
+    draw(&board, &stats);
+  }
+  return REDRAWS;
+}
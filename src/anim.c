@@ -0,0 +1,85 @@
+#include "anim.h"
+#include "trace.h"
+#include <ncurses.h>
+#include <time.h>
+
+#define KEY_QUEUE 64
+
+/* Keys pressed during animations, oldest at 'head' */
+static struct key_queue {
+  int keys[KEY_QUEUE];
+  double times[KEY_QUEUE]; /* when getch() read them */
+  int head;
+  int n;
+} queue;
+
+static double start; /* of the animation, monotonic seconds */
+static bool instant;
+static double key_time; /* of the last key anim_getch() returned */
+static double waited;
+
+static void queue_key(int ch, double at);
+
+void anim_start(void) { start = anim_now(); }
+
+void anim_set_instant(bool on) { instant = on; }
+
+bool anim_wait(double at) {
+  if (instant)
+    return true;
+
+  for (;;) {
+    if (queue.n > 0)
+      return false;
+
+    double left = start + at - anim_now();
+    if (left <= 0)
+      return true;
+
+    double before = anim_now();
+    trace_begin("anim_wait");
+    timeout((int)(left * 1000) + 1);
+    int ch = getch();
+    timeout(-1);
+    trace_end("anim_wait");
+    double after = anim_now();
+    waited += after - before;
+    if (ch != ERR)
+      queue_key(ch, after);
+  }
+}
+
+int anim_getch(int delay_ms) {
+  if (queue.n > 0) {
+    int ch = queue.keys[queue.head];
+    key_time = queue.times[queue.head];
+    queue.head = (queue.head + 1) % KEY_QUEUE;
+    queue.n--;
+    return ch;
+  }
+
+  timeout(delay_ms);
+  int ch = getch();
+  timeout(-1); /* menus wait for their keys */
+  key_time = anim_now();
+  return ch;
+}
+
+double anim_key_time(void) { return key_time; }
+
+double anim_waited(void) { return waited; }
+
+/* Keys past a full queue are dropped, nobody types that far ahead */
+static void queue_key(int ch, double at) {
+  if (queue.n == KEY_QUEUE)
+    return;
+  queue.keys[(queue.head + queue.n) % KEY_QUEUE] = ch;
+  queue.times[(queue.head + queue.n) % KEY_QUEUE] = at;
+  queue.n++;
+}
+
+double anim_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,36 @@
+#ifndef ANIM_H
+#define ANIM_H
+
+#include <stdbool.h>
+
+/* Animations wait for their frames with getch() instead of sleeping.
+ * A key pressed meanwhile is queued for anim_getch() and the animation
+ * skips to its end, so input is never dropped or held up by it */
+
+/* Start timing an animation, frames are due at offsets from now */
+void anim_start(void);
+
+/* Wait until 'at' seconds after anim_start().
+ * Returns false at once if a key is queued or gets pressed, the
+ * animation should then draw its last frame and return */
+bool anim_wait(double at);
+
+/* Don't wait for frames, for benchmarks. anim_wait() then returns true
+ * at once */
+void anim_set_instant(bool on);
+
+/* getch() with a 'delay_ms' timeout (-1 waits for a key), returning
+ * queued keys first */
+int anim_getch(int delay_ms);
+
+/* When getch() read the key anim_getch() last returned, monotonic
+ * seconds */
+double anim_key_time(void);
+
+/* Seconds anim_wait() spent waiting for frames so far */
+double anim_waited(void);
+
+/* Monotonic seconds, the clock of every timing in the game */
+double anim_now(void);
+
+#endif
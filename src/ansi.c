@@ -0,0 +1,175 @@
+#include "render.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NO_ATTRS ((chtype)-1) /* before the first SGR of a frame */
+#define SGR_ATTRS (A_BOLD | A_DIM | A_UNDERLINE | A_REVERSE | A_COLOR)
+
+/* The screen as cells, row by row. 'cells' is what was put, 'shown'
+ * what the terminal shows */
+static struct frame {
+  chtype *cells;
+  chtype *shown;
+  int height, width;
+  Rect panes[PANES];
+  char *out; /* escape sequences of one flush */
+  size_t out_len, out_cap;
+} frame;
+
+static int out_fd = STDOUT_FILENO;
+
+static bool ansi_open(const Rect panes[PANES]);
+static void ansi_close(void);
+static void ansi_put(Pane pane, int y, int x, const chtype *cells, int n);
+static void ansi_flush(Pane pane);
+static void put_sgr(chtype attrs);
+static void put_str(const char *s);
+static void put_out(const char *bytes, size_t n);
+static void write_out(void);
+
+const Renderer ansi_renderer = {.name = "ansi",
+                                .open = ansi_open,
+                                .close = ansi_close,
+                                .put = ansi_put,
+                                .flush = ansi_flush};
+
+void render_set_output(int fd) { out_fd = fd; }
+
+static bool ansi_open(const Rect panes[PANES]) {
+  int cells_n = LINES * COLS;
+  chtype *cells = realloc(frame.cells, cells_n * sizeof(chtype));
+  if (cells)
+    frame.cells = cells;
+  chtype *shown = realloc(frame.shown, cells_n * sizeof(chtype));
+  if (shown)
+    frame.shown = shown;
+  if (!cells || !shown)
+    return false;
+
+  frame.height = LINES;
+  frame.width = COLS;
+  memcpy(frame.panes, panes, sizeof(frame.panes));
+
+  /* ncurses cleared the screen, blanks needn't be written */
+  for (int i = 0; i < cells_n; i++)
+    frame.cells[i] = frame.shown[i] = ' ';
+  return true;
+}
+
+static void ansi_close(void) {
+  free(frame.cells);
+  free(frame.shown);
+  free(frame.out);
+  memset(&frame, 0, sizeof(frame));
+}
+
+static void ansi_put(Pane pane, int y, int x, const chtype *cells, int n) {
+  const Rect *r = &frame.panes[pane];
+
+  if (y < 0 || y >= r->height || r->top + y >= frame.height)
+    return;
+  chtype *row = frame.cells + (r->top + y) * frame.width;
+  for (int i = 0; i < n; i++) {
+    if (x + i >= 0 && x + i < r->width && r->left + x + i < frame.width)
+      row[r->left + x + i] = cells[i];
+  }
+}
+
+/* Writes every changed cell, not only the pane's, so a frame is one
+ * write(). The cursor, attributes and character set are saved and
+ * restored around it, ncurses keeps drawing from where it thinks it is */
+static void ansi_flush(Pane pane) {
+  (void)pane;
+  chtype attrs = NO_ATTRS;
+  bool line_drawing = false;
+  int cursor_y = -1, cursor_x = -1;
+
+  frame.out_len = 0;
+  for (int y = 0; y < frame.height; y++) {
+    for (int x = 0; x < frame.width; x++) {
+      chtype c = frame.cells[y * frame.width + x];
+      if (c == frame.shown[y * frame.width + x])
+        continue;
+      frame.shown[y * frame.width + x] = c;
+
+      if (frame.out_len == 0)
+        put_str("\0337");
+      if (y != cursor_y || x != cursor_x) {
+        char move[32];
+        snprintf(move, sizeof(move), "\033[%d;%dH", y + 1, x + 1);
+        put_str(move);
+      }
+      if ((c & SGR_ATTRS) != attrs) {
+        attrs = c & SGR_ATTRS;
+        put_sgr(attrs);
+      }
+      /* ACS characters are VT100 line drawing characters */
+      if (!!(c & A_ALTCHARSET) != line_drawing) {
+        line_drawing = !line_drawing;
+        put_str(line_drawing ? "\033(0" : "\033(B");
+      }
+      char ch = c & A_CHARTEXT;
+      put_out(&ch, 1);
+      cursor_y = y;
+      cursor_x = x + 1;
+    }
+  }
+  if (frame.out_len == 0)
+    return;
+
+  if (line_drawing)
+    put_str("\033(B");
+  put_str("\0338");
+  write_out();
+}
+
+static void put_sgr(chtype attrs) {
+  char sgr[64];
+  int len = snprintf(sgr, sizeof(sgr), "\033[0%s%s%s%s",
+                     attrs & A_BOLD ? ";1" : "", attrs & A_DIM ? ";2" : "",
+                     attrs & A_UNDERLINE ? ";4" : "",
+                     attrs & A_REVERSE ? ";7" : "");
+  short pair = PAIR_NUMBER(attrs), fg, bg;
+
+  if (pair > 0 && pair_content(pair, &fg, &bg) == OK) {
+    if (fg >= 0)
+      len += snprintf(sgr + len, sizeof(sgr) - len,
+                      fg < 8 ? ";3%d" : ";38;5;%d", fg);
+    if (bg >= 0)
+      len += snprintf(sgr + len, sizeof(sgr) - len,
+                      bg < 8 ? ";4%d" : ";48;5;%d", bg);
+  }
+  snprintf(sgr + len, sizeof(sgr) - len, "m");
+  put_str(sgr);
+}
+
+static void put_str(const char *s) { put_out(s, strlen(s)); }
+
+/* Bytes that don't fit in memory are dropped, init_win() repaints */
+static void put_out(const char *bytes, size_t n) {
+  if (frame.out_len + n > frame.out_cap) {
+    size_t cap = frame.out_cap ? frame.out_cap * 2 : 4096;
+    while (cap < frame.out_len + n)
+      cap *= 2;
+    char *out = realloc(frame.out, cap);
+    if (!out)
+      return;
+    frame.out = out;
+    frame.out_cap = cap;
+  }
+  memcpy(frame.out + frame.out_len, bytes, n);
+  frame.out_len += n;
+}
+
+static void write_out(void) {
+  for (size_t done = 0; done < frame.out_len;) {
+    ssize_t n = write(out_fd, frame.out + done, frame.out_len - done);
+    if (n > 0)
+      done += n;
+    else if (n == -1 && errno != EINTR)
+      break;
+  }
+}
@@ -0,0 +1,249 @@
+#include "autosave.h"
+#include "anim.h"
+#include "history.h"
+#include "save.h"
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+
+/* Copy of the game to be written */
+typedef struct snapshot {
+  Board board;
+  Stats stats;
+  History history;
+  int slot;
+  char description[64];
+} Snapshot;
+
+/* The input thread fills 'next_auto' and 'next_slot', the writer swaps
+ * them with 'writing' and writes without holding the lock */
+static struct writer {
+  pthread_t thread;
+  bool started;
+  bool stopping;
+  pthread_mutex_t lock;
+  pthread_cond_t work;
+  pthread_cond_t idle;
+  Snapshot next_auto;
+  Snapshot next_slot;
+  Snapshot writing;
+  bool auto_queued;
+  bool slot_queued;
+  bool busy;
+  bool slot_pending; /* queued and not polled yet */
+  bool slot_done;
+  int done_slot;
+  int slot_result;
+} writer = {.lock = PTHREAD_MUTEX_INITIALIZER,
+            .work = PTHREAD_COND_INITIALIZER,
+            .idle = PTHREAD_COND_INITIALIZER};
+
+/* Set by autosave_halt(). The writer raises 'saving' and then checks
+ * 'halted', the halt does the reverse, so either the writer sees the
+ * halt or the halt sees the save and waits for it */
+static atomic_bool halted;
+static atomic_bool saving;
+
+static int interval;        /* seconds between auto-saves, 0 for none */
+static double last_auto;    /* when the last auto-save was queued */
+static GameState last_game; /* what it saved */
+
+static void *write_saves(void *arg);
+static bool take_snapshot(Snapshot *snapshot, const Board *board,
+                          const Stats *stats, const History *history);
+static void swap_snapshots(Snapshot *a, Snapshot *b);
+
+int autosave_start(int seconds) {
+  sigset_t all_signals, old_signals;
+
+  interval = seconds;
+  last_auto = anim_now();
+  history_init(&writer.next_auto.history);
+  history_init(&writer.next_slot.history);
+  history_init(&writer.writing.history);
+
+  /* signals are handled on the input thread, which saves on exit */
+  sigfillset(&all_signals);
+  pthread_sigmask(SIG_BLOCK, &all_signals, &old_signals);
+  writer.started =
+      pthread_create(&writer.thread, NULL, write_saves, NULL) == 0;
+  pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+
+  return writer.started ? 0 : -1;
+}
+
+void autosave_tick(const Board *board, const Stats *stats,
+                   const History *history) {
+  if (interval <= 0 || !stats->auto_save ||
+      anim_now() - last_auto < interval)
+    return;
+
+  /* nothing new to save */
+  if (memcmp(&last_game.board, board, sizeof(Board)) == 0 &&
+      memcmp(&last_game.stats, stats, sizeof(Stats)) == 0)
+    return;
+
+  last_auto = anim_now();
+  last_game.board = *board;
+  last_game.stats = *stats;
+
+  if (!writer.started) {
+    auto_save_game(board, stats, history);
+    return;
+  }
+
+  pthread_mutex_lock(&writer.lock);
+  if (take_snapshot(&writer.next_auto, board, stats, history)) {
+    writer.auto_queued = true;
+    pthread_cond_signal(&writer.work);
+  }
+  pthread_mutex_unlock(&writer.lock);
+}
+
+int autosave_slot(const Board *board, const Stats *stats,
+                  const History *history, int slot, const char *description) {
+  if (writer.slot_pending)
+    return -1;
+
+  if (!writer.started) {
+    writer.slot_result =
+        save_game_slot(board, stats, history, slot, description);
+    writer.done_slot = slot;
+    writer.slot_pending = true;
+    writer.slot_done = true;
+    return 0;
+  }
+
+  pthread_mutex_lock(&writer.lock);
+  bool queued = take_snapshot(&writer.next_slot, board, stats, history);
+  if (queued) {
+    writer.next_slot.slot = slot;
+    strncpy(writer.next_slot.description, description ? description : "",
+            sizeof(writer.next_slot.description) - 1);
+    writer.next_slot.description[sizeof(writer.next_slot.description) - 1] =
+        '\0';
+    writer.slot_queued = true;
+    writer.slot_pending = true;
+    pthread_cond_signal(&writer.work);
+  }
+  pthread_mutex_unlock(&writer.lock);
+
+  return queued ? 0 : -1;
+}
+
+bool autosave_poll(int *slot, int *result) {
+  pthread_mutex_lock(&writer.lock);
+  bool done = writer.slot_done;
+  if (done) {
+    *slot = writer.done_slot;
+    *result = writer.slot_result;
+    writer.slot_done = false;
+    writer.slot_pending = false;
+  }
+  pthread_mutex_unlock(&writer.lock);
+  return done;
+}
+
+bool autosave_pending(void) {
+  pthread_mutex_lock(&writer.lock);
+  bool pending = writer.slot_pending;
+  pthread_mutex_unlock(&writer.lock);
+  return pending;
+}
+
+void autosave_wait(void) {
+  pthread_mutex_lock(&writer.lock);
+  while (writer.auto_queued || writer.slot_queued || writer.busy)
+    pthread_cond_wait(&writer.idle, &writer.lock);
+  pthread_mutex_unlock(&writer.lock);
+}
+
+void autosave_stop(void) {
+  if (!writer.started)
+    return;
+
+  pthread_mutex_lock(&writer.lock);
+  writer.stopping = true;
+  pthread_cond_signal(&writer.work);
+  pthread_mutex_unlock(&writer.lock);
+
+  pthread_join(writer.thread, NULL);
+  writer.started = false;
+}
+
+void autosave_halt(void) {
+  const struct timespec pause = {.tv_nsec = 1000000};
+
+  atomic_store(&halted, true);
+  while (atomic_load(&saving))
+    nanosleep(&pause, NULL);
+}
+
+static void *write_saves(void *arg) {
+  (void)arg;
+
+  pthread_mutex_lock(&writer.lock);
+  for (;;) {
+    if (writer.slot_queued) {
+      /* slot saves first, someone's waiting to hear about them */
+      swap_snapshots(&writer.writing, &writer.next_slot);
+      writer.slot_queued = false;
+      writer.busy = true;
+      pthread_mutex_unlock(&writer.lock);
+
+      Snapshot *s = &writer.writing;
+      int result = -1;
+      atomic_store(&saving, true);
+      if (!atomic_load(&halted))
+        result = save_game_slot(&s->board, &s->stats, &s->history, s->slot,
+                                s->description);
+      atomic_store(&saving, false);
+
+      pthread_mutex_lock(&writer.lock);
+      writer.done_slot = s->slot;
+      writer.slot_result = result;
+      writer.slot_done = true;
+    } else if (writer.auto_queued) {
+      swap_snapshots(&writer.writing, &writer.next_auto);
+      writer.auto_queued = false;
+      writer.busy = true;
+      pthread_mutex_unlock(&writer.lock);
+
+      Snapshot *s = &writer.writing;
+      atomic_store(&saving, true);
+      if (!atomic_load(&halted))
+        auto_save_game(&s->board, &s->stats, &s->history);
+      atomic_store(&saving, false);
+
+      pthread_mutex_lock(&writer.lock);
+    } else if (writer.stopping) {
+      break;
+    } else {
+      pthread_cond_wait(&writer.work, &writer.lock);
+      continue;
+    }
+
+    writer.busy = false;
+    if (!writer.auto_queued && !writer.slot_queued)
+      pthread_cond_broadcast(&writer.idle);
+  }
+  pthread_mutex_unlock(&writer.lock);
+  return NULL;
+}
+
+/* Copy the game into 'snapshot', called with the lock held */
+static bool take_snapshot(Snapshot *snapshot, const Board *board,
+                          const Stats *stats, const History *history) {
+  snapshot->board = *board;
+  snapshot->stats = *stats;
+  return history_copy(&snapshot->history, history);
+}
+
+/* Swap whole snapshots, history memory included */
+static void swap_snapshots(Snapshot *a, Snapshot *b) {
+  Snapshot tmp = *a;
+  *a = *b;
+  *b = tmp;
+}
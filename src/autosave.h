@@ -0,0 +1,44 @@
+#ifndef AUTOSAVE_H
+#define AUTOSAVE_H
+
+#include "common.h"
+
+/* Saves run on a writer thread. The game is copied when a save is
+ * requested and written while play goes on, so the input loop never
+ * waits for the disk */
+
+/* Start the writer thread. If 'interval' > 0, autosave_tick() auto-saves
+ * the game every 'interval' seconds while it changes.
+ * Returns 0 or -1 if the thread can't be started, saves then run on the
+ * calling thread */
+int autosave_start(int interval);
+
+/* Queue an auto-save if the interval passed and the game changed since
+ * the last one. Cheap enough to call on every key */
+void autosave_tick(const Board *board, const Stats *stats,
+                   const History *history);
+
+/* Queue a save to 'slot'. autosave_poll() reports when it's done.
+ * Returns -1 if a slot save is already queued */
+int autosave_slot(const Board *board, const Stats *stats,
+                  const History *history, int slot, const char *description);
+
+/* Returns true once per finished slot save, with its slot and the
+ * result of save_game_slot() */
+bool autosave_poll(int *slot, int *result);
+
+/* True while a slot save is queued or being written */
+bool autosave_pending(void);
+
+/* Wait until every queued save is written, before touching save files
+ * on this thread */
+void autosave_wait(void);
+
+/* Write what's queued and stop the thread */
+void autosave_stop(void);
+
+/* Wait for the save being written, if any, and drop every later one.
+ * Async-signal-safe, for a signal handler's save to be the last */
+void autosave_halt(void);
+
+#endif
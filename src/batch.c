@@ -0,0 +1,222 @@
+#include "batch.h"
+#include "bitboard.h"
+#include "board.h"
+#include "rng.h"
+#include "rowtable.h"
+#include "solver.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_JOBS 256
+
+/* Totals of one worker, merged into 'totals' when it's done */
+typedef struct results {
+  long games;
+  long moves;
+  long max_tiles[TILE_VALUES]; /* games per highest tile reached */
+} Results;
+
+static const char *policy_names[] = {"random", "greedy", "solver"};
+
+static const BatchOptions *opts;
+static atomic_long next_game;
+static int *scores; /* final score of each game */
+static Results totals;
+static pthread_mutex_t totals_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *worker(void *arg);
+static void play_game(long game, Results *results);
+static int pick_move(const Board *board, Rng *rng, Board *new_board);
+static void print_results(double seconds);
+static int compare_ints(const void *l, const void *r);
+
+int batch_policy(const char *name) {
+  for (int i = 0; i < (int)(sizeof(policy_names) / sizeof(*policy_names));
+       i++) {
+    if (strcmp(name, policy_names[i]) == 0)
+      return i;
+  }
+  return -1;
+}
+
+int batch_run(const BatchOptions *options) {
+  pthread_t threads[MAX_JOBS];
+  struct timespec start, end;
+  int jobs = options->jobs;
+
+  if (options->games <= 0 || options->board_size < MIN_BOARD_SIZE ||
+      options->board_size > MAX_BOARD_SIZE)
+    return -1;
+
+  if (jobs <= 0)
+    jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  if (jobs < 1)
+    jobs = 1;
+  if (jobs > MAX_JOBS)
+    jobs = MAX_JOBS;
+  if (options->policy == POLICY_SOLVER) {
+    solver_set_threads(jobs);
+    jobs = 1;
+  }
+
+  scores = calloc(options->games, sizeof(*scores));
+  if (!scores)
+    return -1;
+
+  opts = options;
+  atomic_store(&next_game, 0);
+  memset(&totals, 0, sizeof(totals));
+
+  /* lazily built tables must be ready before threads share them */
+  bitboard_init();
+  row_table(options->board_size);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  int started = 0;
+  for (; started < jobs; started++) {
+    if (pthread_create(&threads[started], NULL, worker, NULL) != 0)
+      break;
+  }
+  if (started == 0)
+    worker(NULL);
+  for (int i = 0; i < started; i++)
+    pthread_join(threads[i], NULL);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  print_results((end.tv_sec - start.tv_sec) +
+                (end.tv_nsec - start.tv_nsec) / 1e9);
+
+  free(scores);
+  scores = NULL;
+  return 0;
+}
+
+static void *worker(void *arg) {
+  (void)arg;
+  Results results;
+  long game;
+
+  memset(&results, 0, sizeof(results));
+  while ((game = atomic_fetch_add(&next_game, 1)) < opts->games)
+    play_game(game, &results);
+
+  pthread_mutex_lock(&totals_lock);
+  totals.games += results.games;
+  totals.moves += results.moves;
+  for (int i = 0; i < TILE_VALUES; i++)
+    totals.max_tiles[i] += results.max_tiles[i];
+  pthread_mutex_unlock(&totals_lock);
+  return NULL;
+}
+
+static void play_game(long game, Results *results) {
+  Board board, new_board;
+  Rng rng;
+  int score = 0;
+  int points;
+
+  /* every game gets its own seed, whichever thread plays it */
+  rng_seed(&rng, opts->seed + game);
+  board_start(&board, opts->board_size, &rng);
+  while ((points = pick_move(&board, &rng, &new_board)) != NO_SLIDE) {
+    score += points;
+    board = new_board;
+    board_add_tile(&board, false, &rng);
+    results->moves++;
+  }
+
+  int max_tile = 0;
+  for (int y = 0; y < board.size; y++) {
+    for (int x = 0; x < board.size; x++) {
+      if (board.tiles[y][x] > max_tile)
+        max_tile = board.tiles[y][x];
+    }
+  }
+
+  scores[game] = score;
+  results->max_tiles[max_tile]++;
+  results->games++;
+}
+
+/* Slides the board in the direction chosen by the policy.
+ * Returns points or NO_SLIDE if the game is over */
+static int pick_move(const Board *board, Rng *rng, Board *new_board) {
+  Board slid[4];
+  int points[4];
+  int slides_n = 0;
+  Dir dir;
+
+  if (opts->policy == POLICY_SOLVER) {
+    if (!solver_best_move(board, opts->budget_ms, &dir))
+      return NO_SLIDE;
+    return board_slide(board, new_board, NULL, dir);
+  }
+
+  for (Dir d = UP; d <= RIGHT; d++) {
+    points[d] = board_slide(board, &slid[d], NULL, d);
+    if (points[d] != NO_SLIDE)
+      slides_n++;
+  }
+  if (slides_n == 0)
+    return NO_SLIDE;
+
+  if (opts->policy == POLICY_GREEDY) {
+    /* most points now, first direction on ties */
+    dir = UP;
+    for (Dir d = UP; d <= RIGHT; d++) {
+      if (points[d] > points[dir])
+        dir = d;
+    }
+  } else {
+    /* n-th direction that slides */
+    int n = rng_below(rng, slides_n);
+    for (dir = UP; points[dir] == NO_SLIDE || n-- > 0; dir++)
+      ;
+  }
+
+  *new_board = slid[dir];
+  return points[dir];
+}
+
+static void print_results(double seconds) {
+  long games = totals.games;
+  double sum = 0;
+
+  qsort(scores, games, sizeof(*scores), compare_ints);
+  for (long i = 0; i < games; i++)
+    sum += scores[i];
+
+  printf("policy     %s\n", policy_names[opts->policy]);
+  printf("board      %dx%d\n", opts->board_size, opts->board_size);
+  printf("seed       %llu\n", (unsigned long long)opts->seed);
+  printf("games      %ld\n", games);
+  printf("moves      %ld\n", totals.moves);
+  printf("seconds    %.3f\n", seconds);
+  printf("moves/sec  %.0f\n", seconds > 0 ? totals.moves / seconds : 0);
+  printf("games/sec  %.1f\n", seconds > 0 ? games / seconds : 0);
+  printf("\nscore      mean %.1f  min %d  p10 %d  p50 %d  p90 %d  p99 %d  "
+         "max %d\n",
+         sum / games, scores[0], scores[games * 10 / 100],
+         scores[games * 50 / 100], scores[games * 90 / 100],
+         scores[games * 99 / 100], scores[games - 1]);
+
+  printf("\nmax tile   games      share   reached\n");
+  long reached = games;
+  for (int i = 0; i < TILE_VALUES; i++) {
+    if (totals.max_tiles[i] > 0)
+      printf("%-10d %-10ld %5.1f%%  %6.1f%%\n", 1 << i, totals.max_tiles[i],
+             100.0 * totals.max_tiles[i] / games, 100.0 * reached / games);
+    reached -= totals.max_tiles[i];
+  }
+}
+
+static int compare_ints(const void *l, const void *r) {
+  int a = *(const int *)l;
+  int b = *(const int *)r;
+  return (a > b) - (a < b);
+}
@@ -0,0 +1,27 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "common.h"
+#include <stdint.h>
+
+typedef enum policy { POLICY_RANDOM, POLICY_GREEDY, POLICY_SOLVER } Policy;
+
+typedef struct batch_options {
+  long games;
+  int jobs; /* worker threads, 0 for one per online CPU */
+  int board_size;
+  Policy policy;
+  int budget_ms; /* solver budget per move */
+  uint64_t seed; /* game n is seeded with 'seed + n' */
+} BatchOptions;
+
+/* Returns the policy named 'name' or -1 if there's no such policy */
+int batch_policy(const char *name);
+
+/* Play 'games' games without a terminal and print aggregate results to
+ * stdout. The solver searches on all 'jobs' threads itself, so solver
+ * games are played one at a time.
+ * Returns 0 or -1 on error */
+int batch_run(const BatchOptions *options);
+
+#endif
@@ -0,0 +1,135 @@
+#include "bitboard.h"
+#include <stdbool.h>
+#include <string.h>
+
+#define ROW_MASK 0xFFFFULL
+#define ROWS 65536
+
+/* Slid row for every possible 16-bit row. Points don't depend on the
+ * direction: a run of equal tiles merges the same pairs either way */
+static uint16_t row_left[ROWS];
+static uint16_t row_right[ROWS];
+static int row_points[ROWS];
+static bool tables_ready = false;
+
+static uint16_t reverse_row(uint16_t row);
+static BitBoard transpose(BitBoard board);
+static BitBoard slide_rows(BitBoard board, const uint16_t *table, int *points);
+
+void bitboard_init(void) {
+  if (tables_ready)
+    return;
+
+  for (int row = 0; row < ROWS; row++) {
+    int line[BITBOARD_SIZE] = {0};
+    int n = 0;
+    int points = 0;
+    bool can_merge = false; /* last tile in 'line' hasn't merged yet */
+
+    /* compact tiles to the left, merging equal neighbours once */
+    for (int i = 0; i < BITBOARD_SIZE; i++) {
+      int val = (row >> (4 * i)) & 0xF;
+      if (val == 0)
+        continue;
+      if (can_merge && line[n - 1] == val && val < 15) {
+        line[n - 1]++;
+        points += 1 << line[n - 1];
+        can_merge = false;
+      } else {
+        line[n++] = val;
+        can_merge = true;
+      }
+    }
+
+    uint16_t result = 0;
+    for (int i = 0; i < n; i++)
+      result |= line[i] << (4 * i);
+
+    row_left[row] = result;
+    row_points[row] = points;
+  }
+
+  for (int row = 0; row < ROWS; row++)
+    row_right[row] = reverse_row(row_left[reverse_row(row)]);
+
+  tables_ready = true;
+}
+
+bool bitboard_pack(const Board *board, BitBoard *packed) {
+  if (board->size != BITBOARD_SIZE)
+    return false;
+
+  BitBoard b = 0;
+  for (int y = 0; y < BITBOARD_SIZE; y++) {
+    for (int x = 0; x < BITBOARD_SIZE; x++) {
+      int tile = board->tiles[y][x];
+      if (tile > BITBOARD_MAX_TILE)
+        return false;
+      b |= (BitBoard)tile << (4 * (BITBOARD_SIZE * y + x));
+    }
+  }
+
+  *packed = b;
+  return true;
+}
+
+void bitboard_unpack(BitBoard packed, Board *board) {
+  memset(board, 0, sizeof(Board));
+  board->size = BITBOARD_SIZE;
+  for (int y = 0; y < BITBOARD_SIZE; y++) {
+    for (int x = 0; x < BITBOARD_SIZE; x++)
+      board->tiles[y][x] = (packed >> (4 * (BITBOARD_SIZE * y + x))) & 0xF;
+  }
+}
+
+int bitboard_slide(BitBoard board, BitBoard *new_board, Dir dir) {
+  int points = 0;
+
+  bitboard_init();
+
+  switch (dir) {
+  case LEFT:
+    *new_board = slide_rows(board, row_left, &points);
+    break;
+  case RIGHT:
+    *new_board = slide_rows(board, row_right, &points);
+    break;
+  case UP:
+    /* columns become rows, top of the column is the row's left end */
+    *new_board = transpose(slide_rows(transpose(board), row_left, &points));
+    break;
+  case DOWN:
+    *new_board = transpose(slide_rows(transpose(board), row_right, &points));
+    break;
+  }
+
+  return *new_board == board ? NO_SLIDE : points;
+}
+
+static BitBoard slide_rows(BitBoard board, const uint16_t *table,
+                           int *points) {
+  BitBoard result = 0;
+  for (int i = 0; i < BITBOARD_SIZE; i++) {
+    int row = (board >> (16 * i)) & ROW_MASK;
+    result |= (BitBoard)table[row] << (16 * i);
+    *points += row_points[row];
+  }
+  return result;
+}
+
+static uint16_t reverse_row(uint16_t row) {
+  return (row >> 12) | ((row >> 4) & 0x00F0) | ((row << 4) & 0x0F00) |
+         (row << 12);
+}
+
+/* Swap tile (x, y) with tile (y, x) */
+static BitBoard transpose(BitBoard board) {
+  BitBoard a1 = board & 0xF0F00F0FF0F00F0FULL;
+  BitBoard a2 = board & 0x0000F0F00000F0F0ULL;
+  BitBoard a3 = board & 0x0F0F00000F0F0000ULL;
+  BitBoard a = a1 | (a2 << 12) | (a3 >> 12);
+  BitBoard b1 = a & 0xFF00FF0000FF00FFULL;
+  BitBoard b2 = a & 0x00FF00FF00000000ULL;
+  BitBoard b3 = a & 0x00000000FF00FF00ULL;
+  return b1 | (b2 >> 24) | (b3 << 24);
+}
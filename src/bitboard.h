@@ -0,0 +1,33 @@
+#ifndef BITBOARD_H
+#define BITBOARD_H
+
+#include "board.h"
+#include "common.h"
+#include <stdint.h>
+
+/* 4x4 board packed into one word: 16 nibbles, each holding a tile's
+ * power of two. Tile (x, y) lives at bits 4 * (4 * y + x) */
+typedef uint64_t BitBoard;
+
+#define BITBOARD_SIZE 4
+
+/* Largest tile a Board may hold to be packed. Two of them merge into 15,
+ * the largest value a nibble can store. On the packed engine tiles of
+ * value 15 never merge */
+#define BITBOARD_MAX_TILE 14
+
+/* Build the row tables. Called lazily by the functions below,
+ * call it explicitly before using the engine from several threads */
+void bitboard_init(void);
+
+/* Returns false if the board isn't 4x4 or holds a tile above
+ * BITBOARD_MAX_TILE */
+bool bitboard_pack(const Board *board, BitBoard *packed);
+
+void bitboard_unpack(BitBoard packed, Board *board);
+
+/* Returns points, sets 'new_board'.
+ * Returns NO_SLIDE if didn't slide */
+int bitboard_slide(BitBoard board, BitBoard *new_board, Dir dir);
+
+#endif
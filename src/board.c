@@ -1,188 +1,182 @@
 #include "board.h"
+#include "bitboard.h"
+#include "rowtable.h"
+#include "trace.h"
 #include <stdbool.h>
-#include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
 
-static const int tile_num[] = {0,    2,    4,     8,     16,    32,
-                               64,   128,  256,   512,   1024,  2048,
-                               4096, 8192, 16384, 32768, 65536, 131072};
+static int select_bit(uint32_t mask, int n);
+static inline uint32_t empty_mask(const Board *board, int size);
+static int slide(const Board *board, Board *new_board, Board *moves, Dir dir);
 
-void board_start(Board *board, int size) {
+void board_start(Board *board, int size, Rng *rng) {
   memset(board, 0, sizeof(Board));
   board->size = size;
   /* add only 2's on start */
-  board_add_tile(board, true);
-  board_add_tile(board, true);
+  board_add_tile(board, true, rng);
+  board_add_tile(board, true, rng);
 }
 
-void board_add_tile(Board *board, bool only2) {
-  Coord empty[MAX_BOARD_TILES];
-  int empty_n = 0;
+Coord board_add_tile(Board *board, bool only2, Rng *rng) {
+  trace_begin("board_add_tile");
+  uint32_t empty = board_empty_mask(board);
+  Coord tile = {-1, -1};
   int val;
 
+  if (!rng)
+    rng = rng_thread();
+
   if (only2) {
     val = 1;
   } else {
     /* 10% chance of getting '4' */
-    val = (rand() % 10 == 1) ? 2 : 1;
+    val = (rng_below(rng, 10) == 0) ? 2 : 1;
   }
 
-  for (int y = 0; y < board->size; y++) {
-    for (int x = 0; x < board->size; x++) {
-      if (board->tiles[y][x] == 0) {
-        empty[empty_n].x = x;
-        empty[empty_n].y = y;
-        empty_n++;
-      }
-    }
+  if (empty) {
+    int i = select_bit(empty, rng_below(rng, __builtin_popcount(empty)));
+    tile.x = i % board->size;
+    tile.y = i / board->size;
+    board->tiles[tile.y][tile.x] = val;
   }
+  trace_end("board_add_tile");
+  return tile;
+}
 
-  if (empty_n > 0) {
-    int r = rand() % empty_n;
-    int x = empty[r].x;
-    int y = empty[r].y;
-    board->tiles[y][x] = val;
+/* Built on demand rather than kept in Board: loaders, the history, the
+ * replay reader and the solver's spawns all write tiles directly, and
+ * each would have to keep a stored mask in step */
+uint32_t board_empty_mask(const Board *board) {
+  switch (board->size) {
+  case 3:
+    return empty_mask(board, 3);
+  case 4:
+    return empty_mask(board, 4);
+  case 5:
+    return empty_mask(board, 5);
   }
+  return empty_mask(board, board->size);
 }
 
-static void rotate_l(Board *board);
-static void rotate_r(Board *board);
-static void rotate_2(Board *board);
-static int slide_left(Board *board, Board *moves);
+/* Inlined with a constant 'size', the loops unroll into straight compares */
+static inline uint32_t empty_mask(const Board *board, int size) {
+  uint32_t mask = 0;
 
-int board_slide(const Board *board, Board *new_board, Board *moves, Dir dir) {
-  *new_board = *board;
-
-  /* rotate board */
-  switch (dir) {
-  case RIGHT:
-    rotate_2(new_board);
-    break;
-  case UP:
-    rotate_l(new_board);
-    break;
-  case DOWN:
-    rotate_r(new_board);
-    break;
-  case LEFT:
-    break;
+  for (int y = 0; y < size; y++) {
+    for (int x = 0; x < size; x++)
+      mask |= (uint32_t)(board->tiles[y][x] == 0) << (y * size + x);
   }
+  return mask;
+}
 
-  int points = slide_left(new_board, moves);
-  if (points == NO_SLIDE)
-    return NO_SLIDE;
+/* Index of the n-th (from 0) set bit of 'mask' */
+static int select_bit(uint32_t mask, int n) {
+#ifdef __BMI2__
+  return __builtin_ctz(_pdep_u32(1u << n, mask));
+#else
+  while (n-- > 0)
+    mask &= mask - 1;
+  return __builtin_ctz(mask);
+#endif
+}
 
-  /* rotate back */
-  switch (dir) {
-  case RIGHT:
-    rotate_2(new_board);
-    rotate_2(moves);
-    break;
-  case UP:
-    rotate_r(new_board);
-    rotate_r(moves);
-    break;
-  case DOWN:
-    rotate_l(new_board);
-    rotate_l(moves);
-    break;
-  case LEFT:
-    break;
-  }
+static void line_start(Dir dir, int line, int size, int *x, int *y, int *dx,
+                       int *dy);
 
+int board_slide(const Board *board, Board *new_board, Board *moves, Dir dir) {
+  trace_begin("board_slide");
+  int points = slide(board, new_board, moves, dir);
+  trace_end("board_slide");
   return points;
 }
-bool board_can_slide(const Board *board) {
-  Board b1, b2; /* dummies */
-  if (board_slide(board, &b1, &b2, LEFT) == NO_SLIDE &&
-      board_slide(board, &b1, &b2, RIGHT) == NO_SLIDE &&
-      board_slide(board, &b1, &b2, UP) == NO_SLIDE &&
-      board_slide(board, &b1, &b2, DOWN) == NO_SLIDE) {
-    return false;
-  }
-  return true;
-}
 
-static void rotate_l(Board *board) {
-  Board tmp = *board;
-  for (int y = 0; y < board->size; y++) {
-    for (int x = 0; x < board->size; x++)
-      board->tiles[board->size - 1 - x][y] = tmp.tiles[y][x];
-  }
-}
+static int slide(const Board *board, Board *new_board, Board *moves, Dir dir) {
+  BitBoard packed, new_packed;
 
-static void rotate_r(Board *board) {
-  Board tmp = *board;
-  for (int y = 0; y < board->size; y++) {
-    for (int x = 0; x < board->size; x++)
-      board->tiles[x][board->size - 1 - y] = tmp.tiles[y][x];
+  /* animation isn't needed, use the packed engine if the board fits */
+  if (!moves && bitboard_pack(board, &packed)) {
+    int points = bitboard_slide(packed, &new_packed, dir);
+    if (points != NO_SLIDE)
+      bitboard_unpack(new_packed, new_board);
+    return points;
   }
-}
 
-static void rotate_2(Board *board) {
-  Board tmp = *board;
-  for (int y = 0; y < board->size; y++) {
-    for (int x = 0; x < board->size; x++)
-      board->tiles[y][board->size - 1 - x] = tmp.tiles[y][x];
-  }
-}
-
-static int next_same(int row[MAX_BOARD_SIZE], int val, int start, int size);
-static int next_any(int row[MAX_BOARD_SIZE], int start, int size);
-
-/* returns points or NO_SLIDE if didn't slide */
-static int slide_left(Board *board, Board *moves) {
-  memset(moves, 0, sizeof(Board));
-  moves->size = board->size;
+  const RowSlide *table = row_table(board->size);
+  int size = board->size;
   int points = 0;
   bool slided = false;
 
-  for (int y = 0; y < board->size; y++) {
-    int *row = board->tiles[y];
-    for (int x = 0; x < board->size - 1; x++) {
-      if (row[x] == 0) {
-        int next = next_any(row, x + 1, board->size);
-        if (next == -1)
-          goto NEXT_ROW;
-
-        /* found an empty spot, move next tile here */
-        slided = true;
-        row[x] = row[next];
-        row[next] = 0;
-        moves->tiles[y][next] = next - x;
-      }
-      if (row[x] != 0) {
-        int next = next_same(row, row[x], x + 1, board->size);
-        if (next == -1)
-          continue;
-
-        /* found same tile, merge */
-        slided = true;
-        row[x]++;
-        row[next] = 0;
-        points += tile_num[row[x]];
-        moves->tiles[y][next] = next - x;
-      }
+  *new_board = *board;
+  if (moves) {
+    memset(moves, 0, sizeof(Board));
+    moves->size = size;
+  }
+
+  /* walk each row or column starting from the edge tiles slide to */
+  for (int line = 0; line < size; line++) {
+    int row[MAX_BOARD_SIZE];
+    int x, y, dx, dy;
+
+    line_start(dir, line, size, &x, &y, &dx, &dy);
+    for (int i = 0; i < size; i++)
+      row[i] = board->tiles[y + i * dy][x + i * dx];
+
+    RowSlide r = table[row_key(row, size)];
+    if (!row_slide_slided(r))
+      continue;
+
+    slided = true;
+    points += row_slide_points(r);
+    for (int i = 0; i < size; i++) {
+      new_board->tiles[y + i * dy][x + i * dx] = row_slide_tile(r, i);
+      if (moves)
+        moves->tiles[y + i * dy][x + i * dx] = row_slide_move(r, i);
     }
-  NEXT_ROW:;
   }
 
   return slided ? points : NO_SLIDE;
 }
 
-static int next_any(int row[MAX_BOARD_SIZE], int start, int size) {
-  for (int i = start; i < size; i++)
-    if (row[i] > 0)
-      return i;
-  return -1;
+bool board_can_slide(const Board *board) {
+  int size = board->size;
+
+  /* any empty tile or two equal neighbours allow a slide */
+  for (int y = 0; y < size; y++) {
+    for (int x = 0; x < size; x++) {
+      int tile = board->tiles[y][x];
+      if (tile == 0)
+        return true;
+      if (tile == MAX_TILE)
+        continue;
+      if (x + 1 < size && board->tiles[y][x + 1] == tile)
+        return true;
+      if (y + 1 < size && board->tiles[y + 1][x] == tile)
+        return true;
+    }
+  }
+  return false;
 }
 
-static int next_same(int row[MAX_BOARD_SIZE], int val, int start, int size) {
-  for (int i = start; i < size; i++) {
-    if (row[i] == val)
-      return i;
-    else if (row[i] != 0)
-      return -1;
+/* Sets the first tile of 'line' in sliding order and the step to the next */
+static void line_start(Dir dir, int line, int size, int *x, int *y, int *dx,
+                       int *dy) {
+  switch (dir) {
+  default:
+  case LEFT:
+    *x = 0, *y = line, *dx = 1, *dy = 0;
+    break;
+  case RIGHT:
+    *x = size - 1, *y = line, *dx = -1, *dy = 0;
+    break;
+  case UP:
+    *x = line, *y = 0, *dx = 0, *dy = 1;
+    break;
+  case DOWN:
+    *x = line, *y = size - 1, *dx = 0, *dy = -1;
+    break;
   }
-  return -1;
 }
@@ -2,17 +2,25 @@
 #define BOARD_H
 
 #include "common.h"
+#include "rng.h"
+#include <stdint.h>
 
 #define NO_SLIDE -1
 
-/* Clear board, add two '2' tiles */
-void board_start(Board *board, int size);
+/* Clear board, add two '2' tiles.
+ * Random numbers come from 'rng', or the thread's generator if NULL */
+void board_start(Board *board, int size, Rng *rng);
 
 /* Add tile in random position.
- * If 'only2' is false, the tile may be '2' or '4' */
-void board_add_tile(Board *board, bool only2);
+ * If 'only2' is false, the tile may be '2' or '4'.
+ * Returns the tile's position, {-1, -1} if the board is full */
+Coord board_add_tile(Board *board, bool only2, Rng *rng);
+
+/* Bit 'y * size + x' is set if tile (x, y) is empty */
+uint32_t board_empty_mask(const Board *board);
 
 /* Returns points, sets 'new_board' and 'moves'(needed for animation).
+ * 'moves' may be NULL, 4x4 boards then slide on the packed engine.
  * Returns NO_SLIDE if didn't slide */
 int board_slide(const Board *board, Board *new_board, Board *moves, Dir dir);
 
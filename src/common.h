@@ -6,7 +6,8 @@
 #define MAX_BOARD_SIZE 5
 #define MIN_BOARD_SIZE 3
 #define MAX_BOARD_TILES (MAX_BOARD_SIZE * MAX_BOARD_SIZE)
-#define MAX_HISTORY 50
+#define MAX_HISTORY 50 /* states in version 1 save files */
+#define MAX_TILE 17 /* 2^17 = 131072, two of them never merge */
 
 /* Each tile is represented as power of two,
  * empty tile is 0 */
@@ -36,25 +37,58 @@ typedef struct game_state {
   Stats stats;
 } GameState;
 
-/* History management for undo/redo */
+/* One move in the undo history, enough to replay it from the state
+ * before it */
+typedef struct move_record {
+  int points;         /* score delta */
+  unsigned char dir;  /* Dir, or NO_MOVE for states saved in full */
+  unsigned char tile; /* spawned tile at y * size + x, or NO_MOVE */
+  unsigned char val;  /* spawned tile's power of two */
+} MoveRecord;
+
+#define NO_MOVE 0xFF
+
+/* Full state, kept for saved states and every KEYFRAME_INTERVAL moves */
+typedef struct keyframe {
+  int index;
+  GameState state;
+} Keyframe;
+
+#define KEYFRAME_INTERVAL 32
+
+/* Unbounded undo/redo history. State i is the last keyframe at or
+ * before i with the moves after it replayed */
 typedef struct history {
-  GameState states[MAX_HISTORY];
+  MoveRecord *moves; /* moves[i] leads from state i - 1 to state i */
+  int moves_cap;
+  Keyframe *keyframes; /* ascending index */
+  int keyframes_n;
+  int keyframes_cap;
+  GameState now; /* state 'current' */
   int current;
   int size;
 } History;
 
-/* Enhanced save file structure with version and metadata */
+/* History as stored in version 1 save files, oldest state first */
+typedef struct saved_history {
+  GameState states[MAX_HISTORY];
+  int current;
+  int size;
+} SavedHistory;
+
+/* Version 1 save file structure, written as is after the magic number.
+ * Newer versions are encoded field by field, see save.c */
 typedef struct save_data {
   int version;          /* Save file format version */
   long timestamp;       /* When the game was saved */
   int play_time;        /* Total play time in seconds */
   Board board;          /* Current board state */
   Stats stats;          /* Current game statistics */
-  History history;      /* Undo/redo history */
+  SavedHistory history; /* Undo/redo history */
   char description[64]; /* Optional save description */
 } SaveData;
 
-#define SAVE_VERSION 1
+#define SAVE_VERSION 2
 #define MAX_SAVE_SLOTS 10
 
 #endif
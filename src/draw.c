@@ -1,10 +1,14 @@
 #include "draw.h"
+#include "anim.h"
 #include "history.h"
+#include "latency.h"
+#include "trace.h"
 #include <ncurses.h>
+#include <stdarg.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
 #include <unistd.h>
 
 /* sliding tile */
@@ -18,7 +22,6 @@ static const char *tile_str[] = {
     "        ", "   2    ", "   4    ", "   8    ", "   16   ", "   32   ",
     "   64   ", "  128   ", "  256   ", "  512   ", "  1024  ", "  2048  ",
     "  4096  ", "  8192  ", " 16384  ", " 32768  ", " 65536  ", " 131072 "};
-static const char *empty_tile_str = "          ";
 
 static const NCURSES_ATTR_T tile_attr[] = {
     COLOR_PAIR(1),          COLOR_PAIR(1), /* empty 2 */
@@ -35,41 +38,87 @@ static const NCURSES_ATTR_T tile_attr[] = {
     COLOR_PAIR(3) | A_BOLD,                         /* 131072 */
 };
 
-static const struct timespec tick_time = {.tv_sec = 0, .tv_nsec = 15000000};
-static const struct timespec end_move_time = {.tv_sec = 0, .tv_nsec = 3000000};
+/* Animation timing in seconds, frames are due at multiples of these
+ * from the start of the animation */
+static const double tick_time = 0.015;
+static const double end_move_time = 0.003;
 
 // Undo/Redo animation timing - much slower for visibility
-static const struct timespec undo_step_time = {
-    .tv_sec = 0, .tv_nsec = 150000000}; // 0.15 seconds per step
-static const struct timespec undo_pause_time = {
-    .tv_sec = 0, .tv_nsec = 300000000}; // 0.3 seconds between phases
-
-static WINDOW *board_win;
-static WINDOW *stats_win;
+static const double undo_step_time = 0.15;  // per step
+static const double undo_pause_time = 0.3;  // between phases
+static const double status_time = 0.5;
+
+/* Tiles are drawn in one of these sets of attributes */
+typedef enum glyph_set {
+  GLYPHS_NORMAL,
+  GLYPHS_UNDO_FLASH, /* changed tiles before an undo */
+  GLYPHS_UNDO,       /* and after it */
+  GLYPHS_REDO_FLASH,
+  GLYPHS_REDO,
+  GLYPH_SETS
+} GlyphSet;
+
+/* Every tile pre-composed as rows of chtypes, per value and set of
+ * attributes. Built by init_win(), ACS characters need the terminal */
+static chtype glyphs[GLYPH_SETS][MAX_TILE + 1][TILE_HEIGHT][TILE_WIDTH];
+
+#define STATS_WIDTH 13
+#define LEGEND_ROW 11 /* key legend or latency overlay, to row 21 */
+#define LEGEND_ROWS 11
+
+static const Renderer *out = &curses_renderer;
+static bool opened; /* panes laid out */
 static const History *current_history = NULL;
+static bool show_latency; /* instead of the key legend */
+
+/* What's on screen, so draw() only repaints tiles and fields that
+ * changed. -1 where unknown, init_win() forgets everything */
+static struct shown {
+  int tiles[MAX_BOARD_SIZE][MAX_BOARD_SIZE];
+  bool game_over;
+  int points;
+  int score;
+  int max_score;
+  int auto_save;
+  int undo;
+  int redo;
+} shown;
+
+static void draw_chrome(int board_size);
+static void draw_legend(void);
+static void clear_legend(void);
+static void print_at(Pane pane, int y, int x, chtype attr, const char *format,
+                     ...);
+static void build_glyphs(void);
+static void build_glyph(chtype glyph[TILE_HEIGHT][TILE_WIDTH], int val,
+                        chtype attr);
+static void forget_shown(void);
+static void forget_tiles(int x, int y, int n, Dir dir);
 
 // Set the history pointer for display
 void set_history_display(const History *history) {
   current_history = history;
 }
 
+void set_renderer(const Renderer *renderer) {
+  if (opened)
+    out->close();
+  opened = false;
+  out = renderer;
+}
+
 int init_win(int board_size) {
 
   const int bwidth = TILE_WIDTH * board_size + 2;
   const int bheight = TILE_HEIGHT * board_size + 2;
-  const int swidth = 13;
+  const int swidth = STATS_WIDTH;
   const int min_sheight =
       23; // Minimum height to show all menu options including save/load
   const int sheight = (bheight - 2) > min_sheight ? (bheight - 2) : min_sheight;
 
-  if (board_win) {
-    delwin(board_win);
-    board_win = NULL;
-  }
-  if (stats_win) {
-    delwin(stats_win);
-    stats_win = NULL;
-  }
+  if (opened)
+    out->close();
+  opened = false;
   clear();
   refresh();
 
@@ -93,21 +142,178 @@ int init_win(int board_size) {
     bleft = 0;
   int sleft = bleft + bwidth + 1;
 
-  board_win = newwin(bheight, bwidth, btop, bleft);
-  stats_win = newwin(sheight, swidth, stop, sleft);
-  if (!board_win || !stats_win) {
+  const Rect panes[PANES] = {
+      [PANE_BOARD] = {.top = btop, .left = bleft, .height = bheight,
+                      .width = bwidth},
+      [PANE_STATS] = {.top = stop, .left = sleft, .height = sheight,
+                      .width = swidth}};
+  if (!out->open(panes)) {
     endwin();
     exit(1);
   }
-  wattrset(board_win, COLOR_PAIR(1));
-  wborder(board_win, ACS_VLINE, ACS_VLINE, ACS_HLINE, ACS_HLINE, ACS_ULCORNER,
-          ACS_URCORNER, ACS_LLCORNER, ACS_LRCORNER);
+  opened = true;
+  build_glyphs();
+  draw_chrome(board_size);
+  forget_shown();
 
   return WIN_OK;
 }
 
+/* Borders and labels that never change, drawn once per init_win() */
+static void draw_chrome(int board_size) {
+  const chtype attr = COLOR_PAIR(1);
+  const int width = TILE_WIDTH * board_size + 2;
+  const int height = TILE_HEIGHT * board_size + 2;
+  chtype line[TILE_WIDTH * MAX_BOARD_SIZE + 2];
+
+  // Board border
+  line[0] = ACS_ULCORNER | attr;
+  for (int x = 1; x < width - 1; x++)
+    line[x] = ACS_HLINE | attr;
+  line[width - 1] = ACS_URCORNER | attr;
+  out->put(PANE_BOARD, 0, 0, line, width);
+  line[0] = ACS_LLCORNER | attr;
+  line[width - 1] = ACS_LRCORNER | attr;
+  out->put(PANE_BOARD, height - 1, 0, line, width);
+  line[0] = ACS_VLINE | attr;
+  for (int y = 1; y < height - 1; y++) {
+    out->put(PANE_BOARD, y, 0, line, 1);
+    out->put(PANE_BOARD, y, width - 1, line, 1);
+  }
+
+  print_at(PANE_STATS, 1, 1, COLOR_PAIR(2), "Score");
+  print_at(PANE_STATS, 4, 1, COLOR_PAIR(2), "Best");
+
+  if (show_latency)
+    draw_latency();
+  else
+    draw_legend();
+}
+
+// Keybindings section with cleaner layout
+static void draw_legend(void) {
+  static const struct {
+    const char *key, *action;
+    chtype attr;
+  } legend[] = {
+      {"u", "Undo", COLOR_PAIR(4)},     {"U/y", "Redo", COLOR_PAIR(3)},
+      {"s", "Save", COLOR_PAIR(2)},     {"g", "Load", COLOR_PAIR(3)},
+      {"a", "Animate", COLOR_PAIR(5)},  {"r", "Restart", COLOR_PAIR(6)},
+      {"n", "Hint", COLOR_PAIR(2)},     {"p", "Autoplay", COLOR_PAIR(3)},
+      {"t", "Timing", COLOR_PAIR(5)},   {"q", "Quit", COLOR_PAIR(7)}};
+
+  print_at(PANE_STATS, LEGEND_ROW, 1, COLOR_PAIR(1) | A_DIM, "Keys:");
+  for (int i = 0; i < (int)(sizeof(legend) / sizeof(*legend)); i++) {
+    int len = strlen(legend[i].key);
+    print_at(PANE_STATS, LEGEND_ROW + 1 + i, 1, legend[i].attr | A_BOLD, "%s",
+             legend[i].key);
+    print_at(PANE_STATS, LEGEND_ROW + 1 + i, 2 + len, COLOR_PAIR(1) | A_BOLD,
+             "%s", legend[i].action);
+  }
+}
+
+static void clear_legend(void) {
+  for (int i = 0; i < LEGEND_ROWS; i++)
+    print_at(PANE_STATS, LEGEND_ROW + i, 1, COLOR_PAIR(1), "%*s",
+             STATS_WIDTH - 1, "");
+}
+
+/* Print at (y, x) of 'pane' in 'attr', clipped to the pane */
+static void print_at(Pane pane, int y, int x, chtype attr, const char *format,
+                     ...) {
+  char text[64];
+  chtype cells[sizeof(text)];
+  va_list args;
+
+  va_start(args, format);
+  vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+
+  int n = 0;
+  for (; text[n]; n++)
+    cells[n] = (unsigned char)text[n] | attr;
+  out->put(pane, y, x, cells, n);
+}
+
+static void build_glyphs(void) {
+  static const chtype undo_attr = COLOR_PAIR(4) | A_BOLD;
+  static const chtype redo_attr = COLOR_PAIR(3) | A_BOLD;
+
+  for (int val = 0; val <= MAX_TILE; val++) {
+    build_glyph(glyphs[GLYPHS_NORMAL][val], val, tile_attr[val]);
+    build_glyph(glyphs[GLYPHS_UNDO_FLASH][val], val, undo_attr | A_REVERSE);
+    build_glyph(glyphs[GLYPHS_UNDO][val], val, undo_attr);
+    build_glyph(glyphs[GLYPHS_REDO_FLASH][val], val, redo_attr | A_REVERSE);
+    build_glyph(glyphs[GLYPHS_REDO][val], val, redo_attr);
+  }
+}
+
+/* A bordered tile with its number in the middle row, or blank if empty */
+static void build_glyph(chtype glyph[TILE_HEIGHT][TILE_WIDTH], int val,
+                        chtype attr) {
+  const int right = TILE_WIDTH - 1;
+  const int bottom = TILE_HEIGHT - 1;
+
+  if (val == 0) {
+    for (int y = 0; y < TILE_HEIGHT; y++) {
+      for (int x = 0; x < TILE_WIDTH; x++)
+        glyph[y][x] = ' ' | COLOR_PAIR(1);
+    }
+    return;
+  }
+
+  for (int y = 0; y < TILE_HEIGHT; y++) {
+    const char *text = y == bottom / 2 ? tile_str[val] : tile_str[0];
+    for (int x = 1; x < right; x++)
+      glyph[y][x] = (unsigned char)text[x - 1] | attr;
+    glyph[y][0] = ACS_VLINE | attr;
+    glyph[y][right] = ACS_VLINE | attr;
+  }
+  for (int x = 1; x < right; x++) {
+    glyph[0][x] = ACS_HLINE | attr;
+    glyph[bottom][x] = ACS_HLINE | attr;
+  }
+  glyph[0][0] = ACS_ULCORNER | attr;
+  glyph[0][right] = ACS_URCORNER | attr;
+  glyph[bottom][0] = ACS_LLCORNER | attr;
+  glyph[bottom][right] = ACS_LRCORNER | attr;
+}
+
+static void forget_shown(void) {
+  memset(shown.tiles, -1, sizeof(shown.tiles));
+  shown.game_over = false;
+  shown.points = -1;
+  shown.score = -1;
+  shown.max_score = -1;
+  shown.auto_save = -1;
+  shown.undo = -1;
+  shown.redo = -1;
+}
+
+/* Forget 'n' + 1 tiles from (x, y) towards 'dir', painted over by an
+ * animation */
+static void forget_tiles(int x, int y, int n, Dir dir) {
+  for (int i = 0; i <= n; i++) {
+    switch (dir) {
+    case UP:
+      shown.tiles[y - i][x] = -1;
+      break;
+    case DOWN:
+      shown.tiles[y + i][x] = -1;
+      break;
+    case LEFT:
+      shown.tiles[y][x - i] = -1;
+      break;
+    case RIGHT:
+      shown.tiles[y][x + i] = -1;
+      break;
+    }
+  }
+}
+
 void setup_screen(void) {
-  initscr();
+  if (!stdscr)
+    initscr();
   start_color();
   noecho();
   cbreak();
@@ -157,10 +363,12 @@ void print_too_small(void) {
 
 static void draw_stats(const Stats *stats);
 static void draw_board(const Board *board);
-static void draw_tile(int top, int left, int val);
+static void draw_tile(int top, int left, int val, GlyphSet set);
+static void play_undo_redo(const Board *from_board, const Board *to_board,
+                           bool is_undo);
 
 void draw_history_info(const History *history) {
-  if (!stats_win)
+  if (!opened)
     return;
 
   // Use passed history or the static one
@@ -170,160 +378,106 @@ void draw_history_info(const History *history) {
 
   int undo_count = history_undo_count(h);
   int redo_count = history_redo_count(h);
+  if (undo_count == shown.undo && redo_count == shown.redo)
+    return;
+  shown.undo = undo_count;
+  shown.redo = redo_count;
 
   // Display undo/redo info at position row 8-9
-  wattron(stats_win, COLOR_PAIR(1) | A_DIM);
-  mvwprintw(stats_win, 8, 1, "History:");
-  wattroff(stats_win, A_DIM);
+  print_at(PANE_STATS, 8, 1, COLOR_PAIR(1) | A_DIM, "History:");
+  print_at(PANE_STATS, 9, 1, COLOR_PAIR(1), "%*s", STATS_WIDTH - 1, "");
 
   // Undo count
+  char count[16];
   if (undo_count > 0) {
-    wattron(stats_win, COLOR_PAIR(4) | A_BOLD);
-    mvwprintw(stats_win, 9, 1, "[u%d]", undo_count);
-    wattroff(stats_win, A_BOLD);
+    snprintf(count, sizeof(count), "[u%d]", undo_count);
+    print_at(PANE_STATS, 9, 1, COLOR_PAIR(4) | A_BOLD, "%s", count);
   } else {
-    wattron(stats_win, COLOR_PAIR(1) | A_DIM);
-    mvwprintw(stats_win, 9, 1, "[u-]");
-    wattroff(stats_win, A_DIM);
+    snprintf(count, sizeof(count), "[u-]");
+    print_at(PANE_STATS, 9, 1, COLOR_PAIR(1) | A_DIM, "%s", count);
   }
 
-  // Redo count
-  if (redo_count > 0) {
-    wattron(stats_win, COLOR_PAIR(3) | A_BOLD);
-    mvwprintw(stats_win, 9, 6, "[r%d]", redo_count);
-    wattroff(stats_win, A_BOLD);
-  } else {
-    wattron(stats_win, COLOR_PAIR(1) | A_DIM);
-    mvwprintw(stats_win, 9, 6, "[r-]");
-    wattroff(stats_win, A_DIM);
-  }
+  // Redo count, after the undo count as history has no size limit
+  int x = 1 + strlen(count) + 1;
+  if (redo_count > 0)
+    print_at(PANE_STATS, 9, x, COLOR_PAIR(3) | A_BOLD, "[r%d]", redo_count);
+  else
+    print_at(PANE_STATS, 9, x, COLOR_PAIR(1) | A_DIM, "[r-]");
 }
 
 void draw(const Board *board, const Stats *stats) {
+  trace_begin("draw");
   if (board) {
-    draw_board(board);
-    if (stats && stats->game_over) {
-      wattron(board_win, A_BOLD | COLOR_PAIR(1));
-      mvwprintw(board_win, TILE_HEIGHT * 2, (TILE_WIDTH * board->size - 8) / 2,
-                "GAME OVER");
-      wattroff(board_win, A_BOLD);
+    /* the message covers the second row of tiles */
+    if (stats && shown.game_over && !stats->game_over) {
+      for (int x = 0; x < board->size; x++)
+        shown.tiles[1][x] = -1;
     }
-    wrefresh(board_win);
+    draw_board(board);
+    if (stats && stats->game_over)
+      print_at(PANE_BOARD, TILE_HEIGHT * 2, (TILE_WIDTH * board->size - 8) / 2,
+               COLOR_PAIR(1) | A_BOLD, "GAME OVER");
+    if (stats)
+      shown.game_over = stats->game_over;
+    out->flush(PANE_BOARD);
   }
   if (stats) {
     draw_stats(stats);
     draw_history_info(NULL);  // Use current_history set via set_history_display
-    wrefresh(stats_win);
+    out->flush(PANE_STATS);
   }
+  trace_end("draw");
 }
 
 static void draw_board(const Board *board) {
   for (int y = 0; y < board->size; y++) {
     for (int x = 0; x < board->size; x++) {
+      if (board->tiles[y][x] == shown.tiles[y][x])
+        continue;
+      shown.tiles[y][x] = board->tiles[y][x];
       /* convert board position to window coords */
       int xc = TILE_WIDTH * x + 1;
       int yc = TILE_HEIGHT * y + 1;
-      draw_tile(yc, xc, board->tiles[y][x]);
+      draw_tile(yc, xc, board->tiles[y][x], GLYPHS_NORMAL);
     }
   }
 }
 
 static void draw_stats(const Stats *stats) {
-  wattron(stats_win, COLOR_PAIR(2));
-  mvwprintw(stats_win, 1, 1, "Score");
-  mvwprintw(stats_win, 4, 1, "Best");
-
-  if (stats->points > 0) {
-    wattron(stats_win, COLOR_PAIR(3));
-    mvwprintw(stats_win, 1, 7, "%+6d", stats->points);
-  } else {
-    mvwprintw(stats_win, 1, 7, "       ");
+  if (stats->points != shown.points) {
+    shown.points = stats->points;
+    if (stats->points > 0)
+      print_at(PANE_STATS, 1, 7, COLOR_PAIR(3), "%+6d", stats->points);
+    else
+      print_at(PANE_STATS, 1, 7, COLOR_PAIR(1), "       ");
   }
 
-  if (!stats->auto_save) {
-    wattron(stats_win, COLOR_PAIR(1));
-    mvwprintw(stats_win, 7, 1, "Autosave");
-    wattron(stats_win, COLOR_PAIR(7));
-    mvwprintw(stats_win, 8, 3, "OFF");
+  if (stats->auto_save != shown.auto_save) {
+    shown.auto_save = stats->auto_save;
+    shown.undo = -1; /* "History:" overlaps "OFF" */
+    if (!stats->auto_save) {
+      print_at(PANE_STATS, 7, 1, COLOR_PAIR(1), "Autosave");
+      print_at(PANE_STATS, 8, 3, COLOR_PAIR(7), "OFF");
+    } else {
+      print_at(PANE_STATS, 7, 1, COLOR_PAIR(1), "        ");
+      print_at(PANE_STATS, 8, 3, COLOR_PAIR(1), "   ");
+    }
   }
 
-  wattron(stats_win, COLOR_PAIR(1));
-  mvwprintw(stats_win, 2, 1, "%8d", stats->score);
-  mvwprintw(stats_win, 5, 1, "%8d", stats->max_score);
-
-  // Keybindings section with cleaner layout
-  wattron(stats_win, COLOR_PAIR(1) | A_DIM);
-  mvwprintw(stats_win, 11, 1, "Keys:");
-  wattroff(stats_win, A_DIM);
-
-  wattron(stats_win, COLOR_PAIR(4) | A_BOLD);
-  mvwprintw(stats_win, 12, 1, "u");
-  wattron(stats_win, COLOR_PAIR(1));
-  mvwprintw(stats_win, 12, 3, "Undo");
-
-  wattron(stats_win, COLOR_PAIR(3) | A_BOLD);
-  mvwprintw(stats_win, 13, 1, "U/y");
-  wattron(stats_win, COLOR_PAIR(1));
-  mvwprintw(stats_win, 13, 5, "Redo");
-
-  wattron(stats_win, COLOR_PAIR(2) | A_BOLD);
-  mvwprintw(stats_win, 14, 1, "s");
-  wattron(stats_win, COLOR_PAIR(1));
-  mvwprintw(stats_win, 14, 3, "Save");
-
-  wattron(stats_win, COLOR_PAIR(3) | A_BOLD);
-  mvwprintw(stats_win, 15, 1, "g");
-  wattron(stats_win, COLOR_PAIR(1));
-  mvwprintw(stats_win, 15, 3, "Load");
-
-  wattron(stats_win, COLOR_PAIR(5) | A_BOLD);
-  mvwprintw(stats_win, 16, 1, "a");
-  wattron(stats_win, COLOR_PAIR(1));
-  mvwprintw(stats_win, 16, 3, "Animate");
-
-  wattron(stats_win, COLOR_PAIR(6) | A_BOLD);
-  mvwprintw(stats_win, 17, 1, "r");
-  wattron(stats_win, COLOR_PAIR(1));
-  mvwprintw(stats_win, 17, 3, "Restart");
-
-  wattron(stats_win, COLOR_PAIR(7) | A_BOLD);
-  mvwprintw(stats_win, 18, 1, "q");
-  wattron(stats_win, COLOR_PAIR(1));
-  mvwprintw(stats_win, 18, 3, "Quit");
-}
-
-static void draw_tile(int top, int left, int val) {
-  int right = left + TILE_WIDTH - 1;
-  int bottom = top + TILE_HEIGHT - 1;
-  int center = (top + bottom) / 2;
-
-  /* draw empty tile */
-  if (val == 0) {
-    for (int y = top; y <= bottom; y++)
-      mvwprintw(board_win, y, left, "%s", empty_tile_str);
-    return;
+  if (stats->score != shown.score) {
+    shown.score = stats->score;
+    print_at(PANE_STATS, 2, 1, COLOR_PAIR(1), "%8d", stats->score);
   }
+  if (stats->max_score != shown.max_score) {
+    shown.max_score = stats->max_score;
+    print_at(PANE_STATS, 5, 1, COLOR_PAIR(1), "%8d", stats->max_score);
+  }
+}
 
-  wattrset(board_win, tile_attr[val]);
-
-  /* erase tile except it's border */
-  for (int y = top + 1; y < bottom; y++)
-    mvwprintw(board_win, y, left + 1, "%s", tile_str[0]);
-
-  /* draw corners */
-  mvwaddch(board_win, top, left, ACS_ULCORNER);
-  mvwaddch(board_win, top, right, ACS_URCORNER);
-  mvwaddch(board_win, bottom, left, ACS_LLCORNER);
-  mvwaddch(board_win, bottom, right, ACS_LRCORNER);
-
-  /* draw lines */
-  mvwhline(board_win, top, left + 1, ACS_HLINE, TILE_WIDTH - 2);
-  mvwhline(board_win, bottom, left + 1, ACS_HLINE, TILE_WIDTH - 2);
-  mvwvline(board_win, top + 1, left, ACS_VLINE, TILE_HEIGHT - 2);
-  mvwvline(board_win, top + 1, right, ACS_VLINE, TILE_HEIGHT - 2);
-
-  /* draw number */
-  mvwprintw(board_win, center, left + 1, "%s", tile_str[val]);
+/* Blit a pre-composed tile, one strip per row */
+static void draw_tile(int top, int left, int val, GlyphSet set) {
+  for (int y = 0; y < TILE_HEIGHT; y++)
+    out->put(PANE_BOARD, top + y, left, glyphs[set][val][y], TILE_WIDTH);
 }
 
 /* Passed to qsort */
@@ -331,17 +485,21 @@ static int sort_left(const void *l, const void *r);
 static int sort_right(const void *l, const void *r);
 static int sort_up(const void *l, const void *r);
 static int sort_down(const void *l, const void *r);
+static void play_slide(Tile *tiles, int tiles_n);
 
 void draw_slide(const Board *board, const Board *moves, Dir dir) {
   Tile tiles[MAX_BOARD_TILES]; /* sliding tiles */
   int tiles_n = 0;
 
+  trace_begin("draw_slide");
+
   for (int y = 0; y < board->size; y++) {
     for (int x = 0; x < board->size; x++) {
       if (moves->tiles[y][x] == 0)
         continue;
       Tile tile;
       int step = moves->tiles[y][x];
+      forget_tiles(x, y, step, dir);
       /* convert board position to window coords */
       tile.x = x * TILE_WIDTH + 1;
       tile.y = y * TILE_HEIGHT + 1;
@@ -390,66 +548,57 @@ void draw_slide(const Board *board, const Board *moves, Dir dir) {
   /* sort sliding tiles according to direction */
   qsort(tiles, tiles_n, sizeof(Tile), sort);
 
-  nanosleep(&tick_time, NULL);
+  play_slide(tiles, tiles_n);
+  trace_end("draw_slide");
+}
+
+/* Frames of draw_slide(), a key pressed meanwhile skips the rest and
+ * the caller draws the end */
+static void play_slide(Tile *tiles, int tiles_n) {
+  anim_start();
+  if (!anim_wait(tick_time))
+    return;
   for (int tick = 1; tick <= 3; tick++) {
     for (int t = 0; t < tiles_n; t++) {
       /* erase */
-      draw_tile(tiles[t].y, tiles[t].x, 0);
+      draw_tile(tiles[t].y, tiles[t].x, 0, GLYPHS_NORMAL);
       /* move */
       tiles[t].x += tiles[t].mx;
       tiles[t].y += tiles[t].my;
       /* redraw */
-      draw_tile(tiles[t].y, tiles[t].x, tiles[t].val);
+      draw_tile(tiles[t].y, tiles[t].x, tiles[t].val, GLYPHS_NORMAL);
     }
-    wrefresh(board_win);
-    nanosleep(&tick_time, NULL);
+    out->flush(PANE_BOARD);
+    if (!anim_wait((tick + 1) * tick_time))
+      return;
   }
-  nanosleep(&end_move_time, NULL);
+  anim_wait(4 * tick_time + end_move_time);
 }
 
-static void draw_tile_with_attr(int top, int left, int val,
-                                NCURSES_ATTR_T attr) {
-  int right = left + TILE_WIDTH - 1;
-  int bottom = top + TILE_HEIGHT - 1;
-  int center = (top + bottom) / 2;
-
-  /* draw empty tile */
-  if (val == 0) {
-    wattrset(board_win, COLOR_PAIR(1));
-    for (int y = top; y <= bottom; y++)
-      mvwprintw(board_win, y, left, "%s", empty_tile_str);
+void draw_undo_redo(const Board *from_board, const Board *to_board,
+                    bool is_undo) {
+  if (!opened)
     return;
-  }
-
-  wattrset(board_win, attr);
 
-  /* erase tile except it's border */
-  for (int y = top + 1; y < bottom; y++)
-    mvwprintw(board_win, y, left + 1, "%s", tile_str[0]);
+  trace_begin("draw_undo_redo");
+  // Flash and transition, unless a key skips them
+  anim_start();
+  play_undo_redo(from_board, to_board, is_undo);
 
-  /* draw corners */
-  mvwaddch(board_win, top, left, ACS_ULCORNER);
-  mvwaddch(board_win, top, right, ACS_URCORNER);
-  mvwaddch(board_win, bottom, left, ACS_LLCORNER);
-  mvwaddch(board_win, bottom, right, ACS_LRCORNER);
-
-  /* draw lines */
-  mvwhline(board_win, top, left + 1, ACS_HLINE, TILE_WIDTH - 2);
-  mvwhline(board_win, bottom, left + 1, ACS_HLINE, TILE_WIDTH - 2);
-  mvwvline(board_win, top + 1, left, ACS_VLINE, TILE_HEIGHT - 2);
-  mvwvline(board_win, top + 1, right, ACS_VLINE, TILE_HEIGHT - 2);
-
-  /* draw number */
-  mvwprintw(board_win, center, left + 1, "%s", tile_str[val]);
+  // Step 3: Final state with normal colors
+  memset(shown.tiles, -1, sizeof(shown.tiles));
+  draw_board(to_board);
+  out->flush(PANE_BOARD);
+  trace_end("draw_undo_redo");
 }
 
-void draw_undo_redo(const Board *from_board, const Board *to_board,
-                    bool is_undo) {
-  if (!board_win)
-    return;
-
+/* Steps 1 and 2 of draw_undo_redo(), returns early on a key */
+static void play_undo_redo(const Board *from_board, const Board *to_board,
+                           bool is_undo) {
   // Choose color: blue for undo, green for redo
-  int color_pair = is_undo ? 4 : 3;
+  GlyphSet flash_set = is_undo ? GLYPHS_UNDO_FLASH : GLYPHS_REDO_FLASH;
+  GlyphSet new_set = is_undo ? GLYPHS_UNDO : GLYPHS_REDO;
+  double at = 0;
 
   // Step 1: Flash the old state in highlight color
   for (int flash = 0; flash < 2; flash++) {
@@ -462,26 +611,27 @@ void draw_undo_redo(const Board *from_board, const Board *to_board,
 
         if (from_val != to_val && from_val != 0) {
           // Highlight changed tiles
-          draw_tile_with_attr(yc, xc, from_val, 
-                              COLOR_PAIR(color_pair) | A_BOLD | A_REVERSE);
+          draw_tile(yc, xc, from_val, flash_set);
         } else {
-          draw_tile(yc, xc, from_val);
+          draw_tile(yc, xc, from_val, GLYPHS_NORMAL);
         }
       }
     }
-    wrefresh(board_win);
-    nanosleep(&undo_step_time, NULL);
+    out->flush(PANE_BOARD);
+    if (!anim_wait(at += undo_step_time))
+      return;
 
     // Flash off
     for (int y = 0; y < from_board->size; y++) {
       for (int x = 0; x < from_board->size; x++) {
         int yc = y * TILE_HEIGHT + 1;
         int xc = x * TILE_WIDTH + 1;
-        draw_tile(yc, xc, from_board->tiles[y][x]);
+        draw_tile(yc, xc, from_board->tiles[y][x], GLYPHS_NORMAL);
       }
     }
-    wrefresh(board_win);
-    nanosleep(&undo_step_time, NULL);
+    out->flush(PANE_BOARD);
+    if (!anim_wait(at += undo_step_time))
+      return;
   }
 
   // Step 2: Transition to new state with highlight
@@ -494,41 +644,82 @@ void draw_undo_redo(const Board *from_board, const Board *to_board,
 
       if (from_val != to_val && to_val != 0) {
         // Show new tiles in highlight color
-        draw_tile_with_attr(yc, xc, to_val, 
-                            COLOR_PAIR(color_pair) | A_BOLD);
+        draw_tile(yc, xc, to_val, new_set);
       } else {
-        draw_tile(yc, xc, to_val);
+        draw_tile(yc, xc, to_val, GLYPHS_NORMAL);
       }
     }
   }
-  wrefresh(board_win);
-  nanosleep(&undo_pause_time, NULL);
-
-  // Step 3: Final state with normal colors
-  for (int y = 0; y < to_board->size; y++) {
-    for (int x = 0; x < to_board->size; x++) {
-      int yc = y * TILE_HEIGHT + 1;
-      int xc = x * TILE_WIDTH + 1;
-      draw_tile(yc, xc, to_board->tiles[y][x]);
-    }
-  }
-  wrefresh(board_win);
+  out->flush(PANE_BOARD);
+  anim_wait(at + undo_pause_time);
 }
 
 void draw_undo_redo_status(const char *action) {
-  if (!stats_win)
+  if (!opened)
+    return;
+
+  trace_begin("draw_undo_redo_status");
+  print_at(PANE_STATS, 7, 1, COLOR_PAIR(7) | A_BOLD, "%-10s", action);
+  out->flush(PANE_STATS);
+
+  // Brief display, a key cuts it short
+  anim_start();
+  anim_wait(status_time);
+  print_at(PANE_STATS, 7, 1, COLOR_PAIR(1), "          ");
+  out->flush(PANE_STATS);
+  shown.auto_save = -1;
+  trace_end("draw_undo_redo_status");
+}
+
+void set_latency_display(bool on) {
+  show_latency = on;
+  if (!opened)
     return;
 
-  wattron(stats_win, COLOR_PAIR(7) | A_BOLD);
-  mvwprintw(stats_win, 7, 1, "%-10s", action);
-  wattroff(stats_win, COLOR_PAIR(7) | A_BOLD);
-  wrefresh(stats_win);
+  clear_legend();
+  if (on)
+    draw_latency();
+  else
+    draw_legend();
+  out->flush(PANE_STATS);
+}
+
+void draw_latency(void) {
+  static const double percentiles[] = {50, 95, 99};
+
+  if (!opened || !show_latency)
+    return;
+
+  trace_begin("draw_latency");
+  print_at(PANE_STATS, LEGEND_ROW, 1, COLOR_PAIR(1) | A_DIM, "Latency ms:");
+  for (int i = 0; i < 3; i++) {
+    print_at(PANE_STATS, LEGEND_ROW + 1 + i, 1, COLOR_PAIR(2) | A_BOLD,
+             "p%-4.0f", percentiles[i]);
+    print_at(PANE_STATS, LEGEND_ROW + 1 + i, 6, COLOR_PAIR(1) | A_BOLD,
+             "%7.1f", latency_percentile(SPAN_TOTAL, percentiles[i]));
+  }
+
+  print_at(PANE_STATS, LEGEND_ROW + 4, 1, COLOR_PAIR(1) | A_DIM, "p95 of:");
+  for (LatSpan span = SPAN_SLIDE; span <= SPAN_WAIT; span++) {
+    print_at(PANE_STATS, LEGEND_ROW + 5 + span, 1, COLOR_PAIR(5) | A_BOLD,
+             "%-5s", latency_span_name(span));
+    print_at(PANE_STATS, LEGEND_ROW + 5 + span, 6, COLOR_PAIR(1), "%7.1f",
+             latency_percentile(span, 95));
+  }
+  print_at(PANE_STATS, LEGEND_ROW + 10, 1, COLOR_PAIR(1) | A_DIM, "%-5s%7ld",
+           "moves", latency_moves());
+  out->flush(PANE_STATS);
+  trace_end("draw_latency");
+}
+
+void draw_hint(const char *text) {
+  if (!opened)
+    return;
 
-  // Brief non-blocking display
-  struct timespec short_pause = {.tv_sec = 0, .tv_nsec = 500000000};
-  nanosleep(&short_pause, NULL);
-  mvwprintw(stats_win, 7, 1, "          ");
-  wrefresh(stats_win);
+  trace_begin("draw_hint");
+  print_at(PANE_STATS, 22, 1, COLOR_PAIR(6) | A_BOLD, "%-11s", text);
+  out->flush(PANE_STATS);
+  trace_end("draw_hint");
 }
 
 static int sort_left(const void *l, const void *r) {
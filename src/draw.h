@@ -2,6 +2,7 @@
 #define DRAW_H
 
 #include "common.h"
+#include "render.h"
 
 #define TILE_WIDTH 10
 #define TILE_HEIGHT 5
@@ -9,7 +10,8 @@
 #define WIN_OK 0
 #define WIN_TOO_SMALL -1
 
-/* Set up screen, keyboard, colors */
+/* Set up screen, keyboard, colors. On the terminal unless a screen
+ * was made with newterm() */
 void setup_screen(void);
 
 /* (Re-)initialize board and stats windows.
@@ -23,6 +25,10 @@ void print_too_small(void);
 /* Set history pointer for display (called once during init) */
 void set_history_display(const History *history);
 
+/* Draw through 'renderer' from the next init_win() on, ncurses windows
+ * by default */
+void set_renderer(const Renderer *renderer);
+
 /* Draw board and stats. Both can be omitted if NULL is passed */
 void draw(const Board *board, const Stats *stats);
 
@@ -40,4 +46,13 @@ void draw_undo_redo(const Board *from_board, const Board *to_board,
 /* Display undo/redo status message temporarily */
 void draw_undo_redo_status(const char *action);
 
+/* Show the latency overlay instead of the key legend, or the legend */
+void set_latency_display(bool on);
+
+/* Update the latency overlay if it's shown */
+void draw_latency(void);
+
+/* Display solver hint or autoplay status, empty string clears it */
+void draw_hint(const char *text);
+
 #endif
@@ -1,6 +1,18 @@
 #include "history.h"
+#include "board.h"
+#include "trace.h"
+#include <stdlib.h>
 #include <string.h>
 
+static void push_state(History *history, const GameState *state,
+                       const MoveRecord *move);
+static void drop_redo(History *history);
+static bool reserve(History *history);
+static const Keyframe *find_keyframe(const History *history, int index);
+static void load_state(const History *history, int index, GameState *state);
+static void next_state(const History *history, int index, GameState *state);
+static bool apply_move(GameState *state, const MoveRecord *move);
+
 void history_init(History *history) {
   memset(history, 0, sizeof(History));
   history->current = -1;
@@ -9,32 +21,26 @@ void history_init(History *history) {
 
 void history_save_state(History *history, const Board *board,
                         const Stats *stats) {
-  // If we're not at the end of history, we need to truncate forward history
-  if (history->current < history->size - 1) {
-    history->size = history->current + 1;
-  }
-
-  // Move to next position
-  history->current++;
+  GameState state = {.board = *board, .stats = *stats};
+  MoveRecord move = {.points = 0, .dir = NO_MOVE, .tile = NO_MOVE};
 
-  // If we've reached maximum history, shift everything back
-  if (history->current >= MAX_HISTORY) {
-    for (int i = 0; i < MAX_HISTORY - 1; i++) {
-      history->states[i] = history->states[i + 1];
-    }
-    history->current = MAX_HISTORY - 1;
-  }
+  trace_begin("history_save_state");
+  push_state(history, &state, &move);
+  trace_end("history_save_state");
+}
 
-  // Save current state
-  history->states[history->current].board = *board;
-  history->states[history->current].stats = *stats;
+void history_save_move(History *history, const Board *board,
+                       const Stats *stats, Dir dir, Coord tile) {
+  GameState state = {.board = *board, .stats = *stats};
+  MoveRecord move = {.points = stats->points, .dir = dir, .tile = NO_MOVE};
 
-  // Update size
-  if (history->size < MAX_HISTORY) {
-    history->size = history->current + 1;
-  } else {
-    history->size = MAX_HISTORY;
+  if (tile.x >= 0) {
+    move.tile = tile.y * board->size + tile.x;
+    move.val = board->tiles[tile.y][tile.x];
   }
+  trace_begin("history_save_move");
+  push_state(history, &state, &move);
+  trace_end("history_save_move");
 }
 
 bool history_undo(History *history, Board *board, Stats *stats) {
@@ -42,12 +48,13 @@ bool history_undo(History *history, Board *board, Stats *stats) {
     return false;
   }
 
-  // Move back in history
+  // Move back in history, replaying from the last full state before it
   history->current--;
+  load_state(history, history->current, &history->now);
 
   // Restore state
-  *board = history->states[history->current].board;
-  *stats = history->states[history->current].stats;
+  *board = history->now.board;
+  *stats = history->now.stats;
 
   return true;
 }
@@ -59,15 +66,56 @@ bool history_redo(History *history, Board *board, Stats *stats) {
 
   // Move forward in history
   history->current++;
+  next_state(history, history->current, &history->now);
 
   // Restore state
-  *board = history->states[history->current].board;
-  *stats = history->states[history->current].stats;
+  *board = history->now.board;
+  *stats = history->now.stats;
 
   return true;
 }
 
-void history_clear(History *history) { history_init(history); }
+void history_clear(History *history) {
+  history->keyframes_n = 0;
+  history->current = -1;
+  history->size = 0;
+}
+
+void history_free(History *history) {
+  free(history->moves);
+  free(history->keyframes);
+  history_init(history);
+}
+
+bool history_copy(History *dst, const History *src) {
+  history_clear(dst);
+  if (src->size > dst->moves_cap) {
+    MoveRecord *moves = realloc(dst->moves, src->size * sizeof(MoveRecord));
+    if (!moves)
+      return false;
+    dst->moves = moves;
+    dst->moves_cap = src->size;
+  }
+  if (src->keyframes_n > dst->keyframes_cap) {
+    Keyframe *keyframes =
+        realloc(dst->keyframes, src->keyframes_n * sizeof(Keyframe));
+    if (!keyframes)
+      return false;
+    dst->keyframes = keyframes;
+    dst->keyframes_cap = src->keyframes_n;
+  }
+
+  if (src->size > 0)
+    memcpy(dst->moves, src->moves, src->size * sizeof(MoveRecord));
+  if (src->keyframes_n > 0)
+    memcpy(dst->keyframes, src->keyframes,
+           src->keyframes_n * sizeof(Keyframe));
+  dst->keyframes_n = src->keyframes_n;
+  dst->now = src->now;
+  dst->current = src->current;
+  dst->size = src->size;
+  return true;
+}
 
 bool history_can_undo(const History *history) { return history->current > 0; }
 
@@ -82,3 +130,155 @@ int history_undo_count(const History *history) {
 int history_redo_count(const History *history) {
   return history->size - history->current - 1;
 }
+
+void history_state(const History *history, int index, GameState *state) {
+  if (index == history->current)
+    *state = history->now;
+  else
+    load_state(history, index, state);
+}
+
+bool history_append_move(History *history, const MoveRecord *move) {
+  GameState state;
+
+  history_state(history, history->size - 1, &state);
+  if (!apply_move(&state, move))
+    return false;
+  history->current = history->size - 1;
+  push_state(history, &state, move);
+  return true;
+}
+
+void history_seek(History *history, int index) {
+  history->current = index;
+  load_state(history, index, &history->now);
+}
+
+void history_import(History *history, const SavedHistory *saved) {
+  history_clear(history);
+  for (int i = 0; i < saved->size; i++)
+    history_save_state(history, &saved->states[i].board,
+                       &saved->states[i].stats);
+
+  if (saved->current >= 0 && saved->current < history->size)
+    history_seek(history, saved->current);
+}
+
+// Save a state after the current one, dropping any redo states
+static void push_state(History *history, const GameState *state,
+                       const MoveRecord *move) {
+  static const MoveRecord full_state = {.dir = NO_MOVE, .tile = NO_MOVE};
+
+  drop_redo(history);
+  if (!reserve(history)) {
+    // Out of memory, start over from this state if there's room for it
+    history_clear(history);
+    if (history->moves_cap == 0 || history->keyframes_cap == 0)
+      return;
+    move = &full_state;
+  }
+
+  int index = history->size;
+  history->moves[index] = *move;
+
+  // Keep full states for saved states and every KEYFRAME_INTERVAL moves
+  const Keyframe *last =
+      history->keyframes_n > 0 ? &history->keyframes[history->keyframes_n - 1]
+                               : NULL;
+  if (move->dir == NO_MOVE || !last ||
+      index - last->index >= KEYFRAME_INTERVAL) {
+    Keyframe *keyframe = &history->keyframes[history->keyframes_n++];
+    keyframe->index = index;
+    keyframe->state = *state;
+  }
+
+  history->now = *state;
+  history->current = index;
+  history->size++;
+}
+
+// Drop states after the current one
+static void drop_redo(History *history) {
+  history->size = history->current + 1;
+  while (history->keyframes_n > 0 &&
+         history->keyframes[history->keyframes_n - 1].index > history->current)
+    history->keyframes_n--;
+}
+
+// Make room for one more state and keyframe
+static bool reserve(History *history) {
+  if (history->size == history->moves_cap) {
+    int cap = history->moves_cap ? history->moves_cap * 2 : 64;
+    MoveRecord *moves = realloc(history->moves, cap * sizeof(MoveRecord));
+    if (!moves)
+      return false;
+    history->moves = moves;
+    history->moves_cap = cap;
+  }
+
+  if (history->keyframes_n == history->keyframes_cap) {
+    int cap = history->keyframes_cap ? history->keyframes_cap * 2 : 8;
+    Keyframe *keyframes =
+        realloc(history->keyframes, cap * sizeof(Keyframe));
+    if (!keyframes)
+      return false;
+    history->keyframes = keyframes;
+    history->keyframes_cap = cap;
+  }
+
+  return true;
+}
+
+// Last keyframe at or before 'index'
+static const Keyframe *find_keyframe(const History *history, int index) {
+  int lo = 0, hi = history->keyframes_n - 1;
+  while (lo < hi) {
+    int mid = (lo + hi + 1) / 2;
+    if (history->keyframes[mid].index <= index)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  return &history->keyframes[lo];
+}
+
+static void load_state(const History *history, int index, GameState *state) {
+  const Keyframe *keyframe = find_keyframe(history, index);
+
+  *state = keyframe->state;
+  for (int i = keyframe->index + 1; i <= index; i++)
+    apply_move(state, &history->moves[i]);
+}
+
+// Turn 'state' from state 'index - 1' into state 'index'
+static void next_state(const History *history, int index, GameState *state) {
+  if (history->moves[index].dir == NO_MOVE)
+    *state = find_keyframe(history, index)->state;
+  else
+    apply_move(state, &history->moves[index]);
+}
+
+/* Moves in a history were checked when added, 'state' is left alone if
+ * one doesn't apply */
+static bool apply_move(GameState *state, const MoveRecord *move) {
+  Board new_board;
+  Stats *stats = &state->stats;
+  int size = state->board.size;
+
+  if (board_slide(&state->board, &new_board, NULL, move->dir) == NO_SLIDE)
+    return false;
+  if (move->tile != NO_MOVE) {
+    int *tile = &new_board.tiles[move->tile / size][move->tile % size];
+    if (*tile != 0)
+      return false;
+    *tile = move->val;
+  }
+  state->board = new_board;
+
+  stats->points = move->points;
+  stats->score += move->points;
+  if (stats->score > stats->max_score)
+    stats->max_score = stats->score;
+  stats->game_over = false;
+  return true;
+}
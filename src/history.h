@@ -3,22 +3,35 @@
 
 #include "common.h"
 
-/* Initialize history */
+/* Initialize history, memory is allocated as states are saved */
 void history_init(History *history);
 
-/* Save current game state to history */
+/* Save current game state to history in full */
 void history_save_state(History *history, const Board *board,
                         const Stats *stats);
 
+/* Save the move that led to 'board' and 'stats': a slide in 'dir' and
+ * the tile spawned at 'tile' ({-1, -1} if none). Only the move is kept,
+ * undo replays it from an earlier full state */
+void history_save_move(History *history, const Board *board,
+                       const Stats *stats, Dir dir, Coord tile);
+
 /* Undo last move - returns true if successful */
 bool history_undo(History *history, Board *board, Stats *stats);
 
 /* Redo last undone move - returns true if successful */
 bool history_redo(History *history, Board *board, Stats *stats);
 
-/* Clear all history */
+/* Clear all history, keeping its memory */
 void history_clear(History *history);
 
+/* Free history's memory, history_init() it before using it again */
+void history_free(History *history);
+
+/* Copy 'src' into 'dst', reusing dst's memory.
+ * Returns false if out of memory, 'dst' is then cleared */
+bool history_copy(History *dst, const History *src);
+
 /* Check if undo is possible */
 bool history_can_undo(const History *history);
 
@@ -31,4 +44,19 @@ int history_undo_count(const History *history);
 /* Get number of redo steps available */
 int history_redo_count(const History *history);
 
+/* Get state 'index', replayed from the full state before it */
+void history_state(const History *history, int index, GameState *state);
+
+/* Append 'move' after the newest state, as when reading a save file.
+ * Returns false, appending nothing, if the move doesn't slide or its
+ * tile lands on another */
+bool history_append_move(History *history, const MoveRecord *move);
+
+/* Make state 'index' the current one, keeping the states after it */
+void history_seek(History *history, int index);
+
+/* Load the version 1 save file layout, which holds up to MAX_HISTORY
+ * full states */
+void history_import(History *history, const SavedHistory *saved);
+
 #endif
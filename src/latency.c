@@ -0,0 +1,181 @@
+#include "latency.h"
+#include "anim.h"
+#include <string.h>
+#include <unistd.h>
+
+/* Log-linear buckets of microseconds: 0 to 7 one each, then 8 per
+ * power of two, good to 6%. The last one takes anything over minutes */
+#define SUB_BUCKETS 8
+#define OCTAVES 28
+#define BUCKETS (SUB_BUCKETS * OCTAVES)
+
+typedef struct histogram {
+  long counts[BUCKETS];
+  long n;
+  long max_us;
+} Histogram;
+
+static Histogram histograms[LAT_SPANS];
+
+/* Stamps of the current move, monotonic seconds */
+static struct move {
+  double key;
+  double waited; /* anim_waited() when the key was handled */
+  double stamps[LAT_PAINT + 1];
+  bool started;
+} move;
+
+static const char *span_names[] = {"slide", "draw", "tile",
+                                   "paint", "wait", "total"};
+
+static void record(LatSpan span, double seconds);
+static long percentile_us(LatSpan span, double p);
+static int bucket_of(long us);
+static long bucket_us(int bucket);
+static char *put_text(char *p, const char *text, int width);
+static char *put_long(char *p, long n, int width);
+static char *put_ms(char *p, long us, int width);
+
+void latency_key(double at) {
+  move.key = at;
+  move.waited = anim_waited();
+  move.started = true;
+}
+
+void latency_cancel(void) { move.started = false; }
+
+void latency_stamp(LatStamp stamp) {
+  if (!move.started)
+    return;
+
+  move.stamps[stamp] = anim_now();
+  if (stamp != LAT_PAINT)
+    return;
+
+  record(SPAN_SLIDE, move.stamps[LAT_SLIDE] - move.key);
+  record(SPAN_DRAW, move.stamps[LAT_DRAW] - move.stamps[LAT_SLIDE]);
+  record(SPAN_TILE, move.stamps[LAT_TILE] - move.stamps[LAT_DRAW]);
+  record(SPAN_PAINT, move.stamps[LAT_PAINT] - move.stamps[LAT_TILE]);
+  record(SPAN_WAIT, anim_waited() - move.waited);
+  record(SPAN_TOTAL, move.stamps[LAT_PAINT] - move.key);
+  move.started = false;
+}
+
+long latency_moves(void) { return histograms[SPAN_TOTAL].n; }
+
+double latency_percentile(LatSpan span, double p) {
+  return percentile_us(span, p) / 1e3;
+}
+
+const char *latency_span_name(LatSpan span) { return span_names[span]; }
+
+int latency_dump(int fd) {
+  char buf[512];
+  char *p = buf;
+
+  p = put_text(p, "moves", 11);
+  p = put_long(p, latency_moves(), 0);
+  p = put_text(p, "\n\nspan       p50 ms   p95 ms   p99 ms   max ms\n", 0);
+  for (LatSpan span = 0; span < LAT_SPANS; span++) {
+    p = put_text(p, span_names[span], 11);
+    p = put_ms(p, percentile_us(span, 50), 9);
+    p = put_ms(p, percentile_us(span, 95), 9);
+    p = put_ms(p, percentile_us(span, 99), 9);
+    p = put_ms(p, histograms[span].max_us, 0);
+    p = put_text(p, "\n", 0);
+  }
+
+  for (const char *q = buf; q < p;) {
+    ssize_t n = write(fd, q, p - q);
+    if (n <= 0)
+      return -1;
+    q += n;
+  }
+  return 0;
+}
+
+static void record(LatSpan span, double seconds) {
+  Histogram *h = &histograms[span];
+  long us = seconds > 0 ? (long)(seconds * 1e6) : 0;
+
+  h->counts[bucket_of(us)]++;
+  h->n++;
+  if (us > h->max_us)
+    h->max_us = us;
+}
+
+static long percentile_us(LatSpan span, double p) {
+  const Histogram *h = &histograms[span];
+  long rank = (long)(p / 100 * h->n + 0.5);
+
+  if (h->n == 0)
+    return 0;
+  if (rank < 1)
+    rank = 1;
+  if (rank >= h->n)
+    return h->max_us;
+
+  long seen = 0;
+  for (int i = 0; i < BUCKETS; i++) {
+    seen += h->counts[i];
+    if (seen >= rank) {
+      long us = bucket_us(i);
+      return us < h->max_us ? us : h->max_us;
+    }
+  }
+  return h->max_us;
+}
+
+static int bucket_of(long us) {
+  if (us < SUB_BUCKETS)
+    return us;
+
+  int octave = 63 - __builtin_clzll(us); /* 3 and up */
+  int bucket = (octave - 2) * SUB_BUCKETS + (us >> (octave - 3)) - SUB_BUCKETS;
+  return bucket < BUCKETS ? bucket : BUCKETS - 1;
+}
+
+/* Middle of the bucket's range */
+static long bucket_us(int bucket) {
+  if (bucket < SUB_BUCKETS)
+    return bucket;
+
+  int octave = bucket / SUB_BUCKETS + 2;
+  long low = (long)(SUB_BUCKETS + bucket % SUB_BUCKETS) << (octave - 3);
+  return low + (1l << (octave - 3)) / 2;
+}
+
+/* Append 'text' padded with spaces to 'width' */
+static char *put_text(char *p, const char *text, int width) {
+  size_t len = strlen(text);
+
+  memcpy(p, text, len);
+  for (; len < (size_t)width; len++)
+    p[len] = ' ';
+  return p + len;
+}
+
+static char *put_long(char *p, long n, int width) {
+  char digits[24];
+  int i = sizeof(digits) - 1;
+
+  digits[i] = '\0';
+  do {
+    digits[--i] = '0' + n % 10;
+    n /= 10;
+  } while (n > 0);
+  return put_text(p, digits + i, width);
+}
+
+/* Append 'us' as milliseconds with two decimals */
+static char *put_ms(char *p, long us, int width) {
+  long hundredths = (us + 5) / 10;
+  char ms[32];
+  char *q = put_long(ms, hundredths / 100, 0);
+
+  *q++ = '.';
+  *q++ = '0' + hundredths / 10 % 10;
+  *q++ = '0' + hundredths % 10;
+  *q = '\0';
+  return put_text(p, ms, width);
+}
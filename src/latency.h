@@ -0,0 +1,47 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+/* Where the time between a key and its move on screen goes. main.c
+ * stamps the phases of each move on the monotonic clock, every span
+ * between stamps goes into a histogram */
+
+typedef enum lat_stamp {
+  LAT_SLIDE, /* board_slide() returned */
+  LAT_DRAW,  /* slide animated and result drawn */
+  LAT_TILE,  /* board_add_tile() returned */
+  LAT_PAINT, /* new tile drawn, the move's done */
+} LatStamp;
+
+typedef enum lat_span {
+  SPAN_SLIDE, /* key read to LAT_SLIDE, keys queued meanwhile included */
+  SPAN_DRAW,  /* LAT_SLIDE to LAT_DRAW */
+  SPAN_TILE,  /* LAT_DRAW to LAT_TILE */
+  SPAN_PAINT, /* LAT_TILE to LAT_PAINT */
+  SPAN_WAIT,  /* of the total, waiting for animation frames */
+  SPAN_TOTAL, /* key read to LAT_PAINT */
+  LAT_SPANS
+} LatSpan;
+
+/* A key was read by getch() at 'at', monotonic seconds. Starts a move,
+ * the spans are recorded at its LAT_PAINT */
+void latency_key(double at);
+
+/* The move being made isn't timed, autoplay's aren't */
+void latency_cancel(void);
+
+void latency_stamp(LatStamp stamp);
+
+/* Moves recorded */
+long latency_moves(void);
+
+/* Percentile 'p' (0 to 100) of 'span' in milliseconds, 0 before the
+ * first move */
+double latency_percentile(LatSpan span, double p);
+
+const char *latency_span_name(LatSpan span);
+
+/* Write moves and percentiles of every span to 'fd'. Needs no malloc()
+ * or stdio and works in a signal handler. Returns -1 on write errors */
+int latency_dump(int fd);
+
+#endif
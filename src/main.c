@@ -1,7 +1,20 @@
+#include "anim.h"
+#include "autosave.h"
+#include "batch.h"
 #include "board.h"
 #include "draw.h"
 #include "history.h"
+#include "latency.h"
+#include "replay.h"
+#include "rng.h"
+#include "rowtable.h"
 #include "save.h"
+#include "solver.h"
+#include "trace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
 #include <ncurses.h>
 #include <signal.h>
 #include <stdbool.h>
@@ -11,19 +24,45 @@
 #include <time.h>
 #include <unistd.h>
 
+/* How often getch() wakes up while a save or its status is pending */
+#define SAVE_TICK_MS 100
+#define STATUS_SECONDS 1.0
+
 static sigset_t all_signals;
 static Board board;
 static Stats stats = {.auto_save = false, .game_over = false, .board_size = 4};
 static History history;
+static Rng rng;
+static bool autoplay = false;
+static int autosave_interval = 0; /* seconds, 0 to save on exit only */
+static const char *record_file = NULL;
+static int latency_fd = -1; /* --latency file, written on exit */
+static ReplayOptions replay = {.filename = NULL, .delay_ms = 200};
+static double status_until = 0;   /* when to clear the save status */
+static int status_len = 0;
+
+static const char *dir_names[] = {"Up", "Down", "Left", "Right"};
 
 static int show_menu(void);
 static void show_save_menu(void);
 static void show_load_menu(void);
 static void show_save_status(const char *message);
+static void update_save_status(void);
+static int wait_key(void);
+static void set_autoplay(bool on);
+static void parse_args(int argc, char **argv, BatchOptions *batch);
+static bool parse_long(const char *arg, long min, long max, long *value);
+static bool parse_int(const char *arg, int min, int max, int *value);
+static void usage(FILE *out, const char *prog);
+static void write_latency(void);
 
 static void sig_handler(int __attribute__((unused)) sig_no) {
   sigprocmask(SIG_BLOCK, &all_signals, NULL);
+  autosave_halt();
   save_game(&board, &stats, &history);
+  replay_close();
+  write_latency();
+  trace_stop();
   endwin();
   exit(0);
 }
@@ -94,17 +133,32 @@ static int show_menu(void) {
   }
 }
 
-int main(void) {
-  const struct timespec addtile_time = {.tv_sec = 0, .tv_nsec = 100000000};
+int main(int argc, char **argv) {
+  const double addtile_time = 0.1; /* pause before a tile spawns */
   bool show_animations = 1;
+  bool show_latency = false;
   bool terminal_too_small;
   int board_size;
+  BatchOptions batch = {.games = 0,
+                        .jobs = 0,
+                        .board_size = 4,
+                        .policy = POLICY_RANDOM,
+                        .budget_ms = SOLVER_BUDGET_MS,
+                        .seed = (uint64_t)time(NULL) ^ getpid()};
+
+  parse_args(argc, argv, &batch);
+  if (batch.games > 0)
+    return batch_run(&batch) == 0 ? 0 : 1;
+  if (replay.filename && replay.headless)
+    return replay_play(&replay) == 0 ? 0 : 1;
 
   if (!isatty(fileno(stdout)) || !isatty(fileno(stdin))) {
     exit(1);
   }
+  if (replay.filename)
+    return replay_play(&replay) == 0 ? 0 : 1;
 
-  srand(time(NULL));
+  rng_seed(&rng, batch.seed);
 
   sigfillset(&all_signals);
   sigdelset(&all_signals, SIGKILL);
@@ -121,12 +175,13 @@ int main(void) {
   // Show menu to select board size
   board_size = show_menu();
   stats.board_size = board_size;
+  row_table(board_size); /* build slide table before the first move */
 
   // Initialize history
   history_init(&history);
 
   if (load_game(&board, &stats, &history) != 0 || board.size != board_size) {
-    board_start(&board, board_size);
+    board_start(&board, board_size, &rng);
     stats.score = 0;
     stats.max_score = 0;
     stats.board_size = board_size;
@@ -134,6 +189,13 @@ int main(void) {
 
   // Save initial state to history
   history_save_state(&history, &board, &stats);
+  autosave_start(autosave_interval);
+  if (record_file &&
+      replay_record(record_file, batch.seed, &board, &stats) != 0) {
+    endwin();
+    fprintf(stderr, "%s: can't record to '%s'\n", argv[0], record_file);
+    exit(1);
+  }
 
   setup_screen();
   set_history_display(&history);
@@ -148,7 +210,7 @@ int main(void) {
   sigprocmask(SIG_UNBLOCK, &all_signals, NULL);
 
   int ch;
-  while ((ch = getch()) != 'q' && ch != 'Q') {
+  while ((ch = wait_key()) != 'q' && ch != 'Q') {
     Dir dir;
     Board new_board;
     Board moves;
@@ -180,14 +242,45 @@ int main(void) {
       dir = RIGHT;
       break;
 
+    /* no key pressed during autoplay, let the solver pick */
+    case ERR:
+      if (!autoplay)
+        goto next;
+      if (stats.game_over) {
+        set_autoplay(false);
+        goto next;
+      }
+      /* nothing slides, the slide below detects the game over */
+      if (!solver_best_move(&board, SOLVER_BUDGET_MS, &dir))
+        dir = UP;
+      break;
+
+    /* hint */
+    case 'n':
+    case 'N':
+      if (!stats.game_over &&
+          solver_best_move(&board, SOLVER_BUDGET_MS, &dir)) {
+        char hint[16];
+        snprintf(hint, sizeof(hint), "Hint: %s", dir_names[dir]);
+        draw_hint(hint);
+      }
+      goto next;
+
+    /* toggle autoplay */
+    case 'p':
+    case 'P':
+      set_autoplay(!autoplay && !stats.game_over);
+      goto next;
+
     /* restart */
     case 'r':
     case 'R':
       stats.score = 0;
       stats.game_over = false;
-      board_start(&board, stats.board_size);
+      board_start(&board, stats.board_size, &rng);
       history_clear(&history);
       history_save_state(&history, &board, &stats);
+      replay_board(&board, &stats);
       draw(&board, &stats);
       goto next;
 
@@ -197,6 +290,7 @@ int main(void) {
         Board old_board = board;
 
         if (history_undo(&history, &board, &stats)) {
+          replay_board(&board, &stats);
           if (show_animations) {
             draw_undo_redo(&old_board, &board, true);
           }
@@ -212,6 +306,7 @@ int main(void) {
         Board old_board = board;
 
         if (history_redo(&history, &board, &stats)) {
+          replay_board(&board, &stats);
           if (show_animations) {
             draw_undo_redo(&old_board, &board, false);
           }
@@ -223,6 +318,7 @@ int main(void) {
     /* save game menu */
     case 's':
     case 'S':
+      set_autoplay(false);
       show_save_menu();
       setup_screen();
       if (init_win(stats.board_size) == WIN_TOO_SMALL) {
@@ -237,7 +333,9 @@ int main(void) {
     /* load game menu */
     case 'g':
     case 'G':
+      set_autoplay(false);
       show_load_menu();
+      replay_board(&board, &stats);
       setup_screen();
       if (init_win(stats.board_size) == WIN_TOO_SMALL) {
         terminal_too_small = true;
@@ -248,19 +346,21 @@ int main(void) {
       }
       goto next;
 
-    /* quick save */
+    /* quick save, written in the background */
     case KEY_F(5):
-      if (quick_save(&board, &stats, &history) == 0) {
-        show_save_status("Quick saved to slot 0");
+      if (autosave_slot(&board, &stats, &history, 0, "Quick Save") == 0) {
+        show_save_status("Quick saving to slot 0...");
       } else {
-        show_save_status("Quick save failed");
+        show_save_status("Still saving, try again");
       }
       goto next;
 
     /* quick load */
     case KEY_F(9):
+      autosave_wait();
       if (quick_load(&board, &stats, &history) == 0) {
         show_save_status("Quick loaded from slot 0");
+        replay_board(&board, &stats);
         draw(&board, &stats);
       } else {
         show_save_status("Quick load failed");
@@ -273,6 +373,13 @@ int main(void) {
       show_animations = !show_animations;
       goto next;
 
+    /* toggle latency overlay */
+    case 't':
+    case 'T':
+      show_latency = !show_latency;
+      set_latency_display(show_latency);
+      goto next;
+
     /* terminal resize */
     case KEY_RESIZE:
       if (init_win(stats.board_size) == WIN_TOO_SMALL) {
@@ -290,9 +397,16 @@ int main(void) {
     if (stats.game_over)
       goto next;
 
+    if (ch == ERR)
+      latency_cancel();
+    else
+      latency_key(anim_key_time());
     stats.points = board_slide(&board, &new_board, &moves, dir);
+    latency_stamp(LAT_SLIDE);
 
     if (stats.points >= 0) {
+      if (!autoplay)
+        draw_hint("");
       draw(NULL, &stats); /* show +points */
       if (show_animations)
         draw_slide(&board, &moves, dir);
@@ -302,29 +416,40 @@ int main(void) {
       if (stats.score > stats.max_score)
         stats.max_score = stats.score;
       draw(&board, &stats);
+      latency_stamp(LAT_DRAW);
 
-      nanosleep(&addtile_time, NULL);
-      board_add_tile(&board, false);
+      anim_start();
+      anim_wait(addtile_time);
+      Coord tile = board_add_tile(&board, false, &rng);
+      latency_stamp(LAT_TILE);
       draw(&board, NULL);
-      
-      // Save state after making the move
-      history_save_state(&history, &board, &stats);
+      latency_stamp(LAT_PAINT);
+      draw_latency();
+      replay_move(dir, tile, tile.x >= 0 ? board.tiles[tile.y][tile.x] : 0);
+
+      // Save the move that led to this state
+      history_save_move(&history, &board, &stats, dir, tile);
       /* didn't slide, check if game's over */
     } else if (!board_can_slide(&board)) {
       stats.game_over = true;
+      set_autoplay(false);
       draw(&board, &stats);
     }
-    flushinp();
   next:
+    update_save_status();
+    autosave_tick(&board, &stats, &history);
     sigprocmask(SIG_UNBLOCK, &all_signals, NULL);
   }
 
   /* block all signals before saving */
   sigprocmask(SIG_BLOCK, &all_signals, NULL);
   endwin();
+  autosave_stop();
+  replay_close();
+  write_latency();
 
   if (stats.game_over) {
-    board_start(&board, stats.board_size);
+    board_start(&board, stats.board_size, &rng);
     stats.score = 0;
   }
 
@@ -332,6 +457,183 @@ int main(void) {
   return 0;
 }
 
+static void parse_args(int argc, char **argv, BatchOptions *batch) {
+  static const struct option long_options[] = {
+      {"batch", required_argument, NULL, 'b'},
+      {"policy", required_argument, NULL, 'p'},
+      {"jobs", required_argument, NULL, 'j'},
+      {"size", required_argument, NULL, 's'},
+      {"budget", required_argument, NULL, 't'},
+      {"seed", required_argument, NULL, 'S'},
+      {"autosave", required_argument, NULL, 'A'},
+      {"record", required_argument, NULL, 'r'},
+      {"replay", required_argument, NULL, 'R'},
+      {"delay", required_argument, NULL, 'd'},
+      {"headless", no_argument, NULL, 'H'},
+      {"renderer", required_argument, NULL, 'o'},
+      {"latency", required_argument, NULL, 'L'},
+      {"trace", required_argument, NULL, 'T'},
+      {"help", no_argument, NULL, 'h'},
+      {NULL, 0, NULL, 0}};
+  int opt;
+
+  while ((opt = getopt_long(argc, argv, "b:p:j:s:t:S:A:r:R:d:Ho:L:T:h",
+                            long_options, NULL)) != -1) {
+    switch (opt) {
+    case 'b':
+      if (!parse_long(optarg, 1, LONG_MAX, &batch->games)) {
+        fprintf(stderr, "%s: invalid number of games '%s'\n", argv[0],
+                optarg);
+        exit(1);
+      }
+      break;
+    case 'p':
+      batch->policy = batch_policy(optarg);
+      if ((int)batch->policy < 0) {
+        fprintf(stderr, "%s: unknown policy '%s'\n", argv[0], optarg);
+        exit(1);
+      }
+      break;
+    case 'j':
+      if (!parse_int(optarg, 0, INT_MAX, &batch->jobs)) {
+        fprintf(stderr, "%s: invalid number of jobs '%s'\n", argv[0], optarg);
+        exit(1);
+      }
+      solver_set_threads(batch->jobs);
+      break;
+    case 's':
+      if (!parse_int(optarg, MIN_BOARD_SIZE, MAX_BOARD_SIZE,
+                     &batch->board_size)) {
+        fprintf(stderr, "%s: board size must be %d to %d\n", argv[0],
+                MIN_BOARD_SIZE, MAX_BOARD_SIZE);
+        exit(1);
+      }
+      break;
+    case 't':
+      if (!parse_int(optarg, 0, INT_MAX, &batch->budget_ms)) {
+        fprintf(stderr, "%s: invalid budget '%s'\n", argv[0], optarg);
+        exit(1);
+      }
+      break;
+    case 'S': {
+      char *end;
+      errno = 0;
+      batch->seed = strtoull(optarg, &end, 0);
+      /* strtoull() takes "-1" as the largest seed, a typo more likely */
+      if (errno != 0 || end == optarg || *end != '\0' ||
+          strchr(optarg, '-')) {
+        fprintf(stderr, "%s: invalid seed '%s'\n", argv[0], optarg);
+        exit(1);
+      }
+      break;
+    }
+    case 'A':
+      if (!parse_int(optarg, 1, INT_MAX, &autosave_interval)) {
+        fprintf(stderr, "%s: invalid auto-save interval '%s'\n", argv[0],
+                optarg);
+        exit(1);
+      }
+      break;
+    case 'r':
+      record_file = optarg;
+      break;
+    case 'R':
+      replay.filename = optarg;
+      break;
+    case 'd':
+      if (!parse_int(optarg, 0, INT_MAX, &replay.delay_ms)) {
+        fprintf(stderr, "%s: invalid delay '%s'\n", argv[0], optarg);
+        exit(1);
+      }
+      break;
+    case 'H':
+      replay.headless = true;
+      break;
+    case 'o': {
+      const Renderer *renderer = renderer_named(optarg);
+      if (!renderer) {
+        fprintf(stderr, "%s: unknown renderer '%s'\n", argv[0], optarg);
+        exit(1);
+      }
+      set_renderer(renderer);
+      break;
+    }
+    case 'L':
+      /* opened now, the handler of a signal can't report errors */
+      latency_fd = open(optarg, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (latency_fd == -1) {
+        fprintf(stderr, "%s: can't write '%s'\n", argv[0], optarg);
+        exit(1);
+      }
+      break;
+    case 'T':
+      if (trace_start(optarg) != 0) {
+        fprintf(stderr, "%s: can't trace to '%s'\n", argv[0], optarg);
+        exit(1);
+      }
+      break;
+    case 'h':
+      usage(stdout, argv[0]);
+      exit(0);
+    default:
+      usage(stderr, argv[0]);
+      exit(1);
+    }
+  }
+}
+
+/* Whole of 'arg' as a decimal number from 'min' to 'max' */
+static bool parse_long(const char *arg, long min, long max, long *value) {
+  char *end;
+
+  errno = 0;
+  long n = strtol(arg, &end, 10);
+  if (errno != 0 || end == arg || *end != '\0' || n < min || n > max)
+    return false;
+  *value = n;
+  return true;
+}
+
+static bool parse_int(const char *arg, int min, int max, int *value) {
+  long n;
+
+  if (!parse_long(arg, min, max, &n))
+    return false;
+  *value = n;
+  return true;
+}
+
+static void usage(FILE *out, const char *prog) {
+  fprintf(out,
+          "Usage: %s [options]\n"
+          "\n"
+          "Without --batch or --replay, start the interactive game.\n"
+          "\n"
+          "  -b, --batch N      play N games without a terminal, print results\n"
+          "  -p, --policy NAME  batch move policy: random, greedy or solver\n"
+          "                     (default random)\n"
+          "  -s, --size N       batch board size, 3 to 5 (default 4)\n"
+          "  -j, --jobs N       worker/solver threads (default: one per CPU)\n"
+          "  -t, --budget MS    solver time per move (default %d)\n"
+          "  -S, --seed N       seed for tile spawns, same seed and keys\n"
+          "                     replay the same game (default: clock)\n"
+          "  -A, --autosave SEC auto-save every SEC seconds while playing\n"
+          "                     (default: only on exit)\n"
+          "  -r, --record FILE  record the game's moves to a replay log\n"
+          "  -R, --replay FILE  play a replay log back instead of playing\n"
+          "  -d, --delay MS     replay pause after each move (default 200)\n"
+          "  -H, --headless     replay without a terminal at full speed,\n"
+          "                     print a summary\n"
+          "  -o, --renderer NAME draw with curses or ansi, which writes\n"
+          "                     changed cells as escape codes (default curses)\n"
+          "  -L, --latency FILE write key-to-screen latency percentiles to\n"
+          "                     FILE on exit\n"
+          "  -T, --trace FILE   write a Chrome trace of the game, batch or\n"
+          "                     replay to FILE on exit\n"
+          "  -h, --help         show this help\n",
+          prog, SOLVER_BUDGET_MS);
+}
+
 static void show_save_menu(void) {
   clear();
   int width, height;
@@ -347,7 +649,7 @@ static void show_save_menu(void) {
   mvprintw(4, 2, "Enter slot number (0-9) or ESC to cancel:");
   refresh();
 
-  int ch = getch();
+  int ch = anim_getch(-1);
   if (ch >= '0' && ch <= '9') {
     int slot = ch - '0';
     char description[64];
@@ -363,6 +665,7 @@ static void show_save_menu(void) {
     noecho();
     curs_set(0);
 
+    autosave_wait();
     if (save_game_slot(&board, &stats, &history, slot, description) == 0) {
       mvprintw(8, 2, "Game saved to slot %d successfully!", slot);
     } else {
@@ -371,7 +674,7 @@ static void show_save_menu(void) {
 
     mvprintw(10, 2, "Press any key to continue...");
     refresh();
-    getch();
+    anim_getch(-1);
   }
 }
 
@@ -386,11 +689,11 @@ static void show_load_menu(void) {
   mvprintw(2, 2, "Load Game");
   attroff(COLOR_PAIR(2) | A_BOLD);
 
-  // List available saves
-  char descriptions[MAX_SAVE_SLOTS][64];
-  long timestamps[MAX_SAVE_SLOTS];
+  // List available saves, once saves in the background are written
+  SlotInfo slots[MAX_SAVE_SLOTS];
+  autosave_wait();
 
-  int save_count = list_save_slots(descriptions, timestamps);
+  int save_count = list_save_slot_info(slots);
 
   if (save_count == 0) {
     attron(COLOR_PAIR(7));
@@ -398,7 +701,7 @@ static void show_load_menu(void) {
     attroff(COLOR_PAIR(7));
     mvprintw(6, 2, "Press any key to continue...");
     refresh();
-    getch();
+    anim_getch(-1);
     return;
   }
 
@@ -406,27 +709,29 @@ static void show_load_menu(void) {
   mvprintw(4, 2, "Available saves:");
 
   for (int i = 0; i < MAX_SAVE_SLOTS; i++) {
-    if (descriptions[i][0] != '\0') {
+    if (slots[i].description[0] != '\0') {
       char time_str[64];
-      if (timestamps[i] > 0) {
-        struct tm *tm_info = localtime(&timestamps[i]);
+      if (slots[i].timestamp > 0) {
+        struct tm *tm_info = localtime(&slots[i].timestamp);
         strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M", tm_info);
       } else {
         strcpy(time_str, "Unknown time");
       }
 
-      mvprintw(6 + i, 4, "%d: %s (%s)", i, descriptions[i], time_str);
+      mvprintw(6 + i, 4, "%d: %s (%s, %dx%d, score %d)", i,
+               slots[i].description, time_str, slots[i].board_size,
+               slots[i].board_size, slots[i].score);
     }
   }
 
   mvprintw(18, 2, "Enter slot number (0-9) or ESC to cancel:");
   refresh();
 
-  int ch = getch();
+  int ch = anim_getch(-1);
   if (ch >= '0' && ch <= '9') {
     int slot = ch - '0';
 
-    if (descriptions[slot][0] == '\0') {
+    if (slots[slot].description[0] == '\0') {
       mvprintw(20, 2, "Slot %d is empty!", slot);
     } else if (load_game_slot(&board, &stats, &history, slot) == 0) {
       mvprintw(20, 2, "Game loaded from slot %d successfully!", slot);
@@ -436,7 +741,7 @@ static void show_load_menu(void) {
 
     mvprintw(22, 2, "Press any key to continue...");
     refresh();
-    getch();
+    anim_getch(-1);
   }
 }
 
@@ -445,16 +750,64 @@ static void show_save_status(const char *message) {
   getmaxyx(stdscr, height, width);
   (void)width; // Suppress unused variable warning
 
-  // Show message at bottom of screen
+  // Show message at bottom of screen, update_save_status() clears it
+  mvprintw(height - 2, 2, "%*s", status_len, "");
   attron(COLOR_PAIR(3) | A_BOLD);
   mvprintw(height - 2, 2, "%s", message);
   attroff(COLOR_PAIR(3) | A_BOLD);
   refresh();
 
-  // Brief pause to show message
-  usleep(1000000); // 1 second
+  status_len = strlen(message);
+  status_until = anim_now() + STATUS_SECONDS;
+}
 
-  // Clear the message
-  mvprintw(height - 2, 2, "%*s", (int)strlen(message), "");
-  refresh();
+/* Report finished background saves and clear old status messages */
+static void update_save_status(void) {
+  int slot, result;
+
+  if (autosave_poll(&slot, &result)) {
+    char message[64];
+    if (result == 0)
+      snprintf(message, sizeof(message), "Quick saved to slot %d", slot);
+    else
+      snprintf(message, sizeof(message), "Quick save to slot %d failed",
+               slot);
+    show_save_status(message);
+  } else if (status_until > 0 && anim_now() >= status_until) {
+    int width, height;
+    getmaxyx(stdscr, height, width);
+    (void)width;
+    mvprintw(height - 2, 2, "%*s", status_len, "");
+    refresh();
+    status_until = 0;
+    status_len = 0;
+  }
+}
+
+/* Next key, typed during an animation or not, but don't wait for one
+ * while autoplaying, and wake up regularly while there's a save status
+ * to update or auto-saves to run */
+static int wait_key(void) {
+  int delay = -1;
+
+  if (autoplay)
+    delay = 0;
+  else if (status_until > 0 || autosave_pending() || autosave_interval > 0)
+    delay = SAVE_TICK_MS;
+
+  return anim_getch(delay);
+}
+
+static void set_autoplay(bool on) {
+  autoplay = on;
+  draw_hint(on ? "Autoplay" : "");
+}
+
+/* On either way out, the signal handler's too */
+static void write_latency(void) {
+  if (latency_fd == -1)
+    return;
+  latency_dump(latency_fd);
+  close(latency_fd);
+  latency_fd = -1;
 }
@@ -0,0 +1,78 @@
+#include "render.h"
+#include <string.h>
+
+static WINDOW *windows[PANES];
+
+static bool curses_open(const Rect panes[PANES]);
+static void curses_close(void);
+static void curses_put(Pane pane, int y, int x, const chtype *cells, int n);
+static void curses_flush(Pane pane);
+static bool null_open(const Rect panes[PANES]);
+static void null_close(void);
+static void null_put(Pane pane, int y, int x, const chtype *cells, int n);
+static void null_flush(Pane pane);
+
+const Renderer curses_renderer = {.name = "curses",
+                                  .open = curses_open,
+                                  .close = curses_close,
+                                  .put = curses_put,
+                                  .flush = curses_flush};
+
+const Renderer null_renderer = {.name = "null",
+                                .open = null_open,
+                                .close = null_close,
+                                .put = null_put,
+                                .flush = null_flush};
+
+const Renderer *renderer_named(const char *name) {
+  static const Renderer *renderers[] = {&curses_renderer, &ansi_renderer,
+                                        &null_renderer};
+
+  for (int i = 0; i < (int)(sizeof(renderers) / sizeof(*renderers)); i++) {
+    if (strcmp(name, renderers[i]->name) == 0)
+      return renderers[i];
+  }
+  return NULL;
+}
+
+static bool curses_open(const Rect panes[PANES]) {
+  curses_close();
+  for (int i = 0; i < PANES; i++) {
+    windows[i] = newwin(panes[i].height, panes[i].width, panes[i].top,
+                        panes[i].left);
+    if (!windows[i])
+      return false;
+  }
+  return true;
+}
+
+static void curses_close(void) {
+  for (int i = 0; i < PANES; i++) {
+    if (windows[i])
+      delwin(windows[i]);
+    windows[i] = NULL;
+  }
+}
+
+static void curses_put(Pane pane, int y, int x, const chtype *cells, int n) {
+  mvwaddchnstr(windows[pane], y, x, cells, n);
+}
+
+static void curses_flush(Pane pane) { wrefresh(windows[pane]); }
+
+static bool null_open(const Rect panes[PANES]) {
+  (void)panes;
+  return true;
+}
+
+static void null_close(void) {}
+
+static void null_put(Pane pane, int y, int x, const chtype *cells, int n) {
+  (void)pane;
+  (void)y;
+  (void)x;
+  (void)cells;
+  (void)n;
+}
+
+static void null_flush(Pane pane) { (void)pane; }
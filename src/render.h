@@ -0,0 +1,46 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <ncurses.h>
+#include <stdbool.h>
+
+/* Output backends of draw.c. It lays out the panes and composes cells
+ * as chtypes, a backend puts them on the terminal. ncurses still reads
+ * the keys and draws the menus, whichever backend draws the game */
+
+typedef enum pane { PANE_BOARD, PANE_STATS, PANES } Pane;
+
+typedef struct rect {
+  int top, left;
+  int height, width;
+} Rect;
+
+typedef struct renderer {
+  const char *name;
+  /* Show the panes at 'panes', on a screen ncurses just cleared.
+   * Returns false on error */
+  bool (*open)(const Rect panes[PANES]);
+  void (*close)(void);
+  /* Put 'n' cells at (y, x) of 'pane', clipped to it */
+  void (*put)(Pane pane, int y, int x, const chtype *cells, int n);
+  /* Make what was put on 'pane' visible */
+  void (*flush)(Pane pane);
+} Renderer;
+
+/* ncurses windows, the default */
+extern const Renderer curses_renderer;
+
+/* Own framebuffer, each flush writes the cells that changed since the
+ * last one as ANSI escape sequences in a single write() */
+extern const Renderer ansi_renderer;
+
+/* Draws nothing, to time draw.c alone */
+extern const Renderer null_renderer;
+
+/* Where the ansi backend writes, stdout by default */
+void render_set_output(int fd);
+
+/* Returns the backend named 'name' or NULL */
+const Renderer *renderer_named(const char *name);
+
+#endif
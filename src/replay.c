@@ -0,0 +1,395 @@
+#include "replay.h"
+#include "anim.h"
+#include "board.h"
+#include "draw.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <ncurses.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define REPLAY_MAGIC 0x504C5952 // "RPLY" in hex
+#define REPLAY_VERSION 1
+#define BOARD_RECORD 0xFF
+#define NO_TILE 0x1F
+#define FLUSH_RECORDS 256 /* moves buffered before a write */
+
+/* Replay log, all integers are little-endian:
+ *
+ *   u32 magic, u8 version, u64 seed
+ *   records, a board first:
+ *     board: u8 BOARD_RECORD, u8 size, varint score, varint max_score,
+ *            u8 per tile, row by row
+ *     move:  u8 dir in bits 0-1, spawned tile at y * size + x in bits
+ *            2-6 or NO_TILE, bit 7 set if the tile is a 4
+ *
+ * The log ends with the last whole record, so an interrupted recording
+ * still plays back up to where it stopped */
+
+typedef enum record_kind { RECORD_MOVE, RECORD_BOARD } RecordKind;
+
+typedef struct record {
+  RecordKind kind;
+  Dir dir;
+  int tile; /* y * size + x or NO_TILE */
+  int val;
+  Board board;
+  Stats stats;
+} Record;
+
+/* Log being played back, any bad record sets 'failed' */
+typedef struct reader {
+  FILE *file;
+  long offset;
+  bool failed;
+  bool truncated; /* ends in a partial record */
+} Reader;
+
+/* Records go to 'buf' and are written once FLUSH_RECORDS moves are
+ * buffered or it's full, so recording costs no write() per move */
+static struct recorder {
+  int fd;
+  unsigned char buf[4096];
+  size_t len;
+  int records; /* since the last write */
+  int size;    /* board size of the last board record */
+} recorder = {.fd = -1};
+
+static void put_bytes(const void *bytes, size_t n);
+static void put_varint(uint64_t v);
+static bool get_byte(Reader *r, unsigned *byte, bool at_end);
+static uint64_t get_varint(Reader *r);
+static bool get_record(Reader *r, int size, Record *record);
+static bool play_record(const Record *record, Board *board, Stats *stats,
+                        const ReplayOptions *options);
+static void print_summary(const ReplayOptions *options, uint64_t seed,
+                          const Board *board, const Stats *stats, long moves,
+                          long boards, double seconds);
+
+int replay_record(const char *filename, uint64_t seed, const Board *board,
+                  const Stats *stats) {
+  unsigned char header[13] = {
+      REPLAY_MAGIC & 0xFF, REPLAY_MAGIC >> 8 & 0xFF, REPLAY_MAGIC >> 16 & 0xFF,
+      REPLAY_MAGIC >> 24, REPLAY_VERSION};
+
+  replay_close();
+  recorder.fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+  if (recorder.fd == -1)
+    return -1;
+
+  for (int i = 0; i < 8; i++)
+    header[5 + i] = seed >> (i * 8);
+  put_bytes(header, sizeof(header));
+  replay_board(board, stats);
+  replay_flush();
+
+  return recorder.fd == -1 ? -1 : 0;
+}
+
+void replay_move(Dir dir, Coord tile, int val) {
+  if (recorder.fd == -1)
+    return;
+
+  unsigned char byte = dir | NO_TILE << 2;
+  if (tile.x >= 0)
+    byte = dir | (tile.y * recorder.size + tile.x) << 2 | (val == 2) << 7;
+  put_bytes(&byte, 1);
+
+  if (++recorder.records >= FLUSH_RECORDS)
+    replay_flush();
+}
+
+void replay_board(const Board *board, const Stats *stats) {
+  unsigned char tiles[MAX_BOARD_TILES];
+  unsigned char head[2] = {BOARD_RECORD, board->size};
+
+  if (recorder.fd == -1)
+    return;
+
+  for (int i = 0; i < board->size * board->size; i++)
+    tiles[i] = board->tiles[i / board->size][i % board->size];
+
+  recorder.size = board->size;
+  put_bytes(head, 2);
+  put_varint(stats->score);
+  put_varint(stats->max_score);
+  put_bytes(tiles, board->size * board->size);
+  recorder.records++;
+}
+
+void replay_flush(void) {
+  for (size_t done = 0; done < recorder.len && recorder.fd != -1;) {
+    ssize_t n = write(recorder.fd, recorder.buf + done, recorder.len - done);
+    if (n > 0) {
+      done += n;
+    } else if (n == -1 && errno != EINTR) {
+      /* stop recording, the log keeps what was written */
+      close(recorder.fd);
+      recorder.fd = -1;
+    }
+  }
+  recorder.len = 0;
+  recorder.records = 0;
+}
+
+void replay_close(void) {
+  if (recorder.fd == -1)
+    return;
+
+  replay_flush();
+  if (recorder.fd != -1)
+    close(recorder.fd);
+  recorder.fd = -1;
+}
+
+int replay_play(const ReplayOptions *options) {
+  Reader r = {.file = fopen(options->filename, "rb")};
+  Record record;
+  Board board;
+  Stats stats = {.board_size = 0};
+  uint64_t seed = 0;
+  long moves = 0, boards = 0;
+  long offset = 0;     /* of the record being played */
+  int shown_size = 0; /* board size of the windows */
+  bool quit = false, too_small = false;
+
+  if (!r.file) {
+    fprintf(stderr, "replay: can't open '%s'\n", options->filename);
+    return -1;
+  }
+
+  unsigned char header[13];
+  if (fread(header, 1, sizeof(header), r.file) != sizeof(header) ||
+      (header[0] | header[1] << 8 | header[2] << 16 |
+       (uint32_t)header[3] << 24) != REPLAY_MAGIC ||
+      header[4] != REPLAY_VERSION) {
+    fprintf(stderr, "replay: '%s' isn't a replay log\n", options->filename);
+    fclose(r.file);
+    return -1;
+  }
+  for (int i = 0; i < 8; i++)
+    seed |= (uint64_t)header[5 + i] << (i * 8);
+  r.offset = sizeof(header);
+
+  if (!options->headless)
+    setup_screen();
+
+  double start = anim_now();
+  for (offset = r.offset; !quit && get_record(&r, stats.board_size, &record);
+       offset = r.offset) {
+    if (!options->headless && record.kind == RECORD_BOARD &&
+        record.board.size != shown_size) {
+      too_small = init_win(record.board.size) == WIN_TOO_SMALL;
+      if (too_small)
+        break;
+      shown_size = record.board.size;
+    }
+
+    if (record.kind == RECORD_MOVE && stats.board_size == 0)
+      r.failed = true; /* moves need a board to start from */
+    else if (!play_record(&record, &board, &stats, options))
+      r.failed = true;
+    if (r.failed)
+      break;
+
+    if (record.kind == RECORD_MOVE)
+      moves++;
+    else
+      boards++;
+    if (!options->headless && record.kind == RECORD_MOVE) {
+      int ch = anim_getch(options->delay_ms);
+      quit = ch == 'q' || ch == 'Q';
+    }
+  }
+  double seconds = anim_now() - start;
+  fclose(r.file);
+
+  if (boards > 0)
+    stats.game_over = !board_can_slide(&board);
+  if (!options->headless) {
+    if (!quit && !too_small && boards > 0) {
+      draw(&board, &stats);
+      draw_hint("Replay end");
+      anim_getch(-1);
+    }
+    endwin();
+  }
+
+  if (too_small) {
+    fprintf(stderr, "replay: terminal is too small\n");
+    return -1;
+  }
+  if (r.failed || boards == 0) {
+    fprintf(stderr, "replay: '%s': bad record at byte %ld\n",
+            options->filename, offset);
+    return -1;
+  }
+  if (r.truncated)
+    fprintf(stderr, "replay: '%s' ends in a partial record at byte %ld\n",
+            options->filename, offset);
+  print_summary(options, seed, &board, &stats, moves, boards, seconds);
+  return 0;
+}
+
+static void put_bytes(const void *bytes, size_t n) {
+  if (recorder.len + n > sizeof(recorder.buf))
+    replay_flush();
+  memcpy(recorder.buf + recorder.len, bytes, n);
+  recorder.len += n;
+}
+
+/* 7 bits per byte, low bits first, high bit set on all but the last */
+static void put_varint(uint64_t v) {
+  unsigned char bytes[10];
+  int n = 0;
+
+  while (v >= 0x80) {
+    bytes[n++] = (v & 0x7F) | 0x80;
+    v >>= 7;
+  }
+  bytes[n++] = v;
+  put_bytes(bytes, n);
+}
+
+/* End of file between records, where 'at_end' is set, ends the log.
+ * Anywhere else, recording stopped in the middle of a record */
+static bool get_byte(Reader *r, unsigned *byte, bool at_end) {
+  int c = getc(r->file);
+  if (c == EOF) {
+    r->failed |= ferror(r->file) != 0;
+    r->truncated |= !at_end;
+    return false;
+  }
+  r->offset++;
+  *byte = c;
+  return true;
+}
+
+static uint64_t get_varint(Reader *r) {
+  uint64_t v = 0;
+  unsigned byte;
+
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (!get_byte(r, &byte, false))
+      return 0;
+    v |= (uint64_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80))
+      return v;
+  }
+  r->failed = true;
+  return 0;
+}
+
+/* Read the next record of a game on a 'size' board.
+ * Returns false at the end of the log or on a bad record */
+static bool get_record(Reader *r, int size, Record *record) {
+  unsigned byte;
+
+  if (!get_byte(r, &byte, true))
+    return false;
+
+  if (byte != BOARD_RECORD) {
+    record->kind = RECORD_MOVE;
+    record->dir = byte & 3;
+    record->tile = byte >> 2 & NO_TILE;
+    record->val = byte & 0x80 ? 2 : 1;
+    if (record->tile != NO_TILE && record->tile >= size * size)
+      r->failed = true;
+    return !r->failed;
+  }
+
+  record->kind = RECORD_BOARD;
+  if (!get_byte(r, &byte, false))
+    return false;
+  if (byte < MIN_BOARD_SIZE || byte > MAX_BOARD_SIZE) {
+    r->failed = true;
+    return false;
+  }
+  memset(&record->board, 0, sizeof(Board));
+  memset(&record->stats, 0, sizeof(Stats));
+  record->board.size = byte;
+  record->stats.board_size = byte;
+  uint64_t score = get_varint(r);
+  uint64_t max_score = get_varint(r);
+  if (score > INT32_MAX || max_score > INT32_MAX)
+    r->failed = true;
+  record->stats.score = score;
+  record->stats.max_score = max_score;
+
+  for (int i = 0; i < record->board.size * record->board.size; i++) {
+    if (!get_byte(r, &byte, false))
+      break;
+    if (byte > MAX_TILE)
+      r->failed = true;
+    record->board.tiles[i / record->board.size][i % record->board.size] = byte;
+  }
+  return !r->failed && !r->truncated;
+}
+
+/* Apply 'record' to the game, drawing it unless headless.
+ * Returns false if a move doesn't slide or spawns on a tile */
+static bool play_record(const Record *record, Board *board, Stats *stats,
+                        const ReplayOptions *options) {
+  Board new_board, moves;
+
+  if (record->kind == RECORD_BOARD) {
+    *board = record->board;
+    *stats = record->stats;
+    if (!options->headless) {
+      draw(board, stats);
+      draw_hint("Replay");
+    }
+    return true;
+  }
+
+  stats->points = board_slide(board, &new_board,
+                              options->headless ? NULL : &moves, record->dir);
+  if (stats->points == NO_SLIDE)
+    return false;
+  if (!options->headless) {
+    draw(NULL, stats); /* show +points */
+    draw_slide(board, &moves, record->dir);
+  }
+
+  *board = new_board;
+  stats->score += stats->points;
+  if (stats->score > stats->max_score)
+    stats->max_score = stats->score;
+
+  if (record->tile != NO_TILE) {
+    int *tile = &board->tiles[record->tile / board->size]
+                             [record->tile % board->size];
+    if (*tile != 0)
+      return false;
+    *tile = record->val;
+  }
+
+  if (!options->headless)
+    draw(board, stats);
+  return true;
+}
+
+static void print_summary(const ReplayOptions *options, uint64_t seed,
+                          const Board *board, const Stats *stats, long moves,
+                          long boards, double seconds) {
+  int max_tile = 0;
+  for (int y = 0; y < board->size; y++) {
+    for (int x = 0; x < board->size; x++) {
+      if (board->tiles[y][x] > max_tile)
+        max_tile = board->tiles[y][x];
+    }
+  }
+
+  printf("replay     %s\n", options->filename);
+  printf("board      %dx%d\n", board->size, board->size);
+  printf("seed       %llu\n", (unsigned long long)seed);
+  printf("moves      %ld\n", moves);
+  printf("boards     %ld\n", boards);
+  printf("score      %d\n", stats->score);
+  printf("max tile   %d\n", max_tile ? 1 << max_tile : 0);
+  printf("game over  %s\n", stats->game_over ? "yes" : "no");
+  printf("seconds    %.3f\n", seconds);
+  if (options->headless)
+    printf("moves/sec  %.0f\n", seconds > 0 ? moves / seconds : 0);
+}
@@ -0,0 +1,42 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "common.h"
+#include <stdint.h>
+
+/* Replay logs record a game move by move: the seed, then the board
+ * whenever it changes other than by a move (start, restart, undo, load)
+ * and the direction and spawned tile of every move. Records are
+ * buffered and written in batches */
+
+typedef struct replay_options {
+  const char *filename;
+  int delay_ms;  /* pause after each move */
+  bool headless; /* no terminal, print a summary */
+} ReplayOptions;
+
+/* Start recording to 'filename', replacing it, from 'board'.
+ * Returns 0 or -1 on error */
+int replay_record(const char *filename, uint64_t seed, const Board *board,
+                  const Stats *stats);
+
+/* Record a move in 'dir' that spawned tile 'tile' of value 'val',
+ * 'tile' is {-1, -1} if none spawned */
+void replay_move(Dir dir, Coord tile, int val);
+
+/* Record a board that didn't come from a move */
+void replay_board(const Board *board, const Stats *stats);
+
+/* Write out buffered records. Only uses write(), safe in signal
+ * handlers */
+void replay_flush(void);
+
+/* Flush and stop recording */
+void replay_close(void);
+
+/* Play a replay log back with board_slide(), on the terminal or
+ * headless at full speed.
+ * Returns 0 or -1 if the log can't be read or doesn't replay */
+int replay_play(const ReplayOptions *options);
+
+#endif
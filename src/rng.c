@@ -0,0 +1,56 @@
+#include "rng.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+static _Thread_local Rng thread_rng;
+static _Thread_local bool thread_rng_ready = false;
+
+static uint64_t splitmix64(uint64_t *state);
+static uint64_t rotl(uint64_t x, int k);
+
+void rng_seed(Rng *rng, uint64_t seed) {
+  for (int i = 0; i < 4; i++)
+    rng->s[i] = splitmix64(&seed);
+}
+
+uint64_t rng_next(Rng *rng) {
+  uint64_t *s = rng->s;
+  uint64_t result = rotl(s[1] * 5, 7) * 9;
+  uint64_t t = s[1] << 17;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rotl(s[3], 45);
+
+  return result;
+}
+
+uint32_t rng_below(Rng *rng, uint32_t n) {
+  /* scale the top 32 bits instead of a slow modulo */
+  return ((rng_next(rng) >> 32) * n) >> 32;
+}
+
+Rng *rng_thread(void) {
+  if (!thread_rng_ready) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    /* each thread's generator has its own address */
+    rng_seed(&thread_rng, (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec +
+                              (uintptr_t)&thread_rng);
+    thread_rng_ready = true;
+  }
+  return &thread_rng;
+}
+
+static uint64_t splitmix64(uint64_t *state) {
+  uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
@@ -0,0 +1,23 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+/* xoshiro256** generator. Cheap to copy, no shared state */
+typedef struct rng {
+  uint64_t s[4];
+} Rng;
+
+/* Expand 'seed' into a full state, equal seeds give equal sequences */
+void rng_seed(Rng *rng, uint64_t seed);
+
+uint64_t rng_next(Rng *rng);
+
+/* Returns a number in [0, n) */
+uint32_t rng_below(Rng *rng, uint32_t n);
+
+/* The calling thread's own generator, seeded from the clock and the
+ * thread on first use */
+Rng *rng_thread(void);
+
+#endif
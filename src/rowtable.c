@@ -0,0 +1,90 @@
+#include "rowtable.h"
+#include <stdbool.h>
+#include <stdlib.h>
+
+/* Rows of 3, 4 and 5 cells have 18^3, 18^4 and 18^5 possible contents */
+#define ROWS_3 (TILE_VALUES * TILE_VALUES * TILE_VALUES)
+#define ROWS_4 (ROWS_3 * TILE_VALUES)
+#define ROWS_5 (ROWS_4 * TILE_VALUES)
+
+static RowSlide rows_3[ROWS_3];
+static RowSlide rows_4[ROWS_4];
+static RowSlide rows_5[ROWS_5];
+static bool ready[MAX_BOARD_SIZE + 1];
+
+static RowSlide slide_row(const int *row, int size);
+
+const RowSlide *row_table(int size) {
+  RowSlide *table;
+  int rows;
+
+  switch (size) {
+  case 3:
+    table = rows_3;
+    rows = ROWS_3;
+    break;
+  case 4:
+    table = rows_4;
+    rows = ROWS_4;
+    break;
+  case 5:
+    table = rows_5;
+    rows = ROWS_5;
+    break;
+  default:
+    abort(); /* a bug, any other table would slide the wrong cells */
+  }
+
+  if (ready[size])
+    return table;
+
+  int row[MAX_BOARD_SIZE] = {0};
+  for (int key = 0; key < rows; key++) {
+    table[key] = slide_row(row, size);
+
+    /* next row: increment the base TILE_VALUES counter */
+    for (int i = 0; i < size && ++row[i] == TILE_VALUES; i++)
+      row[i] = 0;
+  }
+
+  ready[size] = true;
+  return table;
+}
+
+static RowSlide slide_row(const int *row, int size) {
+  int line[MAX_BOARD_SIZE] = {0};
+  int moves[MAX_BOARD_SIZE] = {0};
+  int n = 0;
+  int points = 0;
+  bool slided = false;
+  bool can_merge = false; /* last tile in 'line' hasn't merged yet */
+
+  for (int i = 0; i < size; i++) {
+    if (row[i] == 0)
+      continue;
+    if (can_merge && line[n - 1] == row[i] && row[i] < MAX_TILE) {
+      /* found same tile, merge */
+      line[n - 1]++;
+      points += 1 << line[n - 1];
+      moves[i] = i - (n - 1);
+      can_merge = false;
+    } else {
+      /* move to the first free spot */
+      line[n] = row[i];
+      moves[i] = i - n;
+      n++;
+      can_merge = true;
+    }
+    if (moves[i] != 0)
+      slided = true;
+  }
+
+  RowSlide r = 0;
+  for (int i = 0; i < size; i++) {
+    r |= (RowSlide)line[i] << (5 * i);
+    r |= (RowSlide)moves[i] << (25 + 3 * i);
+  }
+  r |= (RowSlide)points << 40;
+  r |= (RowSlide)slided << 63;
+  return r;
+}
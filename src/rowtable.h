@@ -0,0 +1,44 @@
+#ifndef ROWTABLE_H
+#define ROWTABLE_H
+
+#include "common.h"
+#include <stdint.h>
+
+#define TILE_VALUES (MAX_TILE + 1)
+
+/* Result of sliding one row toward its first cell, packed as:
+ * bits  0-24  slid row, 5 bits per cell
+ * bits 25-39  distance each source cell moved, 3 bits per cell
+ * bits 40-58  points
+ * bit  63     set if anything moved */
+typedef uint64_t RowSlide;
+
+/* Returns the table for rows of 'size' cells, building it on first use.
+ * Rows are keyed by row_key(). 'size' must be 3, 4 or 5, anything else
+ * aborts */
+const RowSlide *row_table(int size);
+
+/* Key of a row: its tiles read as a base TILE_VALUES number,
+ * 'row[0]' being the least significant digit */
+static inline int row_key(const int *row, int size) {
+  int key = 0;
+  for (int i = size - 1; i >= 0; i--)
+    key = key * TILE_VALUES + row[i];
+  return key;
+}
+
+static inline int row_slide_tile(RowSlide r, int i) {
+  return (r >> (5 * i)) & 0x1F;
+}
+
+static inline int row_slide_move(RowSlide r, int i) {
+  return (r >> (25 + 3 * i)) & 0x7;
+}
+
+static inline int row_slide_points(RowSlide r) {
+  return (r >> 40) & 0x7FFFF;
+}
+
+static inline bool row_slide_slided(RowSlide r) { return r >> 63; }
+
+#endif
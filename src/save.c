@@ -1,47 +1,184 @@
 #include "save.h"
 #include "common.h"
+#include "board.h"
+#include "history.h"
+#include "trace.h"
+#include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/file.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
 
 #define PATH_LEN 512
 #define MAGIC_NUMBER 0x32303438 // "2048" in hex
+#define RAW_VERSION 1           // SaveData written as is
+#define INDEX_VERSION 1
+#define MAX_SAVE_BYTES (64 << 20)
+
+/* Save file, version 2 and up. All integers are little-endian:
+ *
+ *   u32 magic, u32 version
+ *   varint timestamp, varint play_time, varint length + description
+ *   state: u8 size, varint score, varint max_score, varint points,
+ *          u8 flags (1 game over, 2 auto save),
+ *          board as 5 bits per tile, row by row, padded to a byte
+ *   history: varint size, varint current, then per state
+ *            u8 NO_MOVE and a state (the first one always), or
+ *            u8 dir, u8 spawned tile or NO_MOVE, u8 its value,
+ *            varint points
+ *   u32 CRC-32 of everything after the magic number
+ *
+ * Tiles go up to MAX_TILE, so they don't fit in a nibble.
+ *
+ * The index file caches what the load menu shows of every slot:
+ *
+ *   u32 magic, u32 INDEX_VERSION, varint MAX_SAVE_SLOTS
+ *   per slot: u8 SlotState, and unless it's SLOT_UNKNOWN or
+ *             SLOT_MISSING, varint mtime seconds, varint mtime
+ *             nanoseconds and varint size of the slot file, then
+ *             if it's SLOT_VALID, varint timestamp, varint score,
+ *             u8 board size, varint length + description
+ *   u32 CRC-32 of everything after the magic number
+ *
+ * An entry is stale when its slot file's mtime or size changed */
+
+/* Fields of the save file other than the game itself */
+typedef struct save_header {
+  long timestamp;
+  int play_time;
+  char description[64];
+} SaveHeader;
+
+/* Save file being written to 'fd' through a fixed buffer, so saving
+ * needs no malloc() or stdio and works in a signal handler */
+typedef struct writer {
+  int fd;
+  unsigned char buf[4096];
+  size_t len;
+  size_t written; /* bytes written before 'buf' */
+  uint32_t crc;   /* of the written bytes after the magic number */
+  bool failed;    /* write error */
+} Writer;
+
+/* Save file being decoded, any bad field sets 'failed' */
+typedef struct reader {
+  const unsigned char *p;
+  const unsigned char *end;
+  bool failed;
+} Reader;
+
+typedef enum slot_state {
+  SLOT_UNKNOWN, /* not indexed yet */
+  SLOT_MISSING,
+  SLOT_INVALID, /* a file that doesn't load */
+  SLOT_VALID
+} SlotState;
+
+/* Index entry of one slot */
+typedef struct slot_entry {
+  SlotState state;
+  long mtime_sec;
+  long mtime_nsec;
+  long file_size;
+  SlotInfo info;
+} SlotEntry;
 
 static char save_dir[PATH_LEN] = "";
-static int legacy_fd = -1;
+static int lock_fd = -1; /* held by the instance that auto-saves */
 static bool auto_save_enabled = false;
 
+/* Auto-save paths, set by load_game() so save_game() is signal safe.
+ * Periodic auto-saves have a temp file of their own, as the one on exit
+ * may happen while they're written */
+static char legacy_filename[PATH_LEN] = "";
+static char legacy_tmp_filename[PATH_LEN + 4] = "";
+static char periodic_tmp_filename[PATH_LEN + 9] = "";
+static char home_dir[PATH_LEN] = "";
+
 // Internal function declarations
 static int init_save_dir(void);
 static int get_legacy_filename(char *filename);
 static int get_slot_filename(int slot, char *filename);
+static int get_index_filename(char *filename);
+static bool read_index(SlotEntry entries[MAX_SAVE_SLOTS]);
+static int write_index(const SlotEntry entries[MAX_SAVE_SLOTS]);
+static bool refresh_entry(int slot, SlotEntry *entry);
+static void set_entry_file(SlotEntry *entry, const struct stat *st);
+static const unsigned char *map_file(const char *filename, size_t *len);
 static bool validate_save_data(const SaveData *data);
-static int write_save_data(const char *filename, const SaveData *data);
-static int read_save_data(const char *filename, SaveData *data);
-static void create_save_data(const Board *board, const Stats *stats,
-                             const History *history, const char *description,
-                             SaveData *save_data);
+static int write_save_data(const char *filename, const char *tmp_filename,
+                           const char *dir, const SaveHeader *header,
+                           const Board *board, const Stats *stats,
+                           const History *history);
+static int open_tmp_file(const char *tmp_filename, Writer *w);
+static int commit_tmp_file(Writer *w, const char *tmp_filename,
+                           const char *filename, const char *dir);
+static int read_save_data(const char *filename, SaveHeader *header,
+                          Board *board, Stats *stats, History *history);
+static int decode_raw(const unsigned char *data, size_t len,
+                      SaveHeader *header, Board *board, Stats *stats,
+                      History *history);
+static int decode(const unsigned char *data, size_t len, SaveHeader *header,
+                  Board *board, Stats *stats, History *history);
+static bool get_history(Reader *r, int size, int board_size,
+                        History *history);
+static void create_header(const char *description, SaveHeader *header);
+static void flush(Writer *w);
+static void put_bytes(Writer *w, const void *bytes, size_t n);
+static void put_u8(Writer *w, unsigned v);
+static void put_u32(Writer *w, uint32_t v);
+static void put_varint(Writer *w, uint64_t v);
+static void put_state(Writer *w, const Board *board, const Stats *stats);
+static unsigned get_u8(Reader *r);
+static uint32_t get_u32(Reader *r);
+static uint64_t get_varint(Reader *r);
+static int get_int(Reader *r);
+static void get_state(Reader *r, Board *board, Stats *stats);
+static void get_move(Reader *r, int size, MoveRecord *move);
+static bool play_move(Board *board, const MoveRecord *move);
+static uint32_t crc32(uint32_t crc, const unsigned char *data, size_t len);
+static bool check_crc(const unsigned char *data, size_t len);
 
 // Legacy load function (maintains compatibility)
 int load_game(Board *board, Stats *stats, History *history) {
-  char filename[PATH_LEN];
+  char *filename = legacy_filename;
+  char lock_filename[PATH_LEN];
 
-  if (get_legacy_filename(filename) == -1)
+  if (get_legacy_filename(filename) == -1 || init_save_dir() != 0)
     return -1;
-
-  legacy_fd = open(filename, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
-  if (legacy_fd == -1)
+  snprintf(legacy_tmp_filename, sizeof(legacy_tmp_filename), "%s.tmp",
+           filename);
+  snprintf(periodic_tmp_filename, sizeof(periodic_tmp_filename),
+           "%s.auto.tmp", filename);
+  snprintf(home_dir, sizeof(home_dir), "%s", getenv("HOME"));
+  crc32(0, NULL, 0); /* build the table before saves run anywhere else */
+
+  /* Only one instance auto-saves. The lock is on a file of its own, as
+   * saves replace the save file with a new one */
+  if (snprintf(lock_filename, PATH_LEN, "%s/autosave.lock", save_dir) >=
+      PATH_LEN)
     return -1;
-
-  if (flock(legacy_fd, LOCK_EX | LOCK_NB) != -1)
+  lock_fd = open(lock_filename, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+  if (lock_fd != -1 && flock(lock_fd, LOCK_EX | LOCK_NB) != -1)
     auto_save_enabled = true;
+  stats->auto_save = auto_save_enabled; /* even if there's nothing to load */
+
+  int legacy_fd = open(filename, O_RDONLY);
+  if (legacy_fd == -1) {
+    if (!auto_save_enabled && lock_fd != -1) {
+      close(lock_fd);
+      lock_fd = -1;
+    }
+    return -1;
+  }
 
   // Try to read legacy format first
   struct {
@@ -63,51 +200,64 @@ int load_game(Board *board, Stats *stats, History *history) {
     stats->points = 0;
     *board = legacy_data.board;
 
-    // Initialize empty history for legacy saves
-    history->current = -1;
-    history->size = 0;
+    // Start empty history for legacy saves
+    history_clear(history);
 
     // Validate the loaded data
     if (stats->score >= 0 && stats->max_score >= 0 &&
         stats->board_size >= MIN_BOARD_SIZE &&
         stats->board_size <= MAX_BOARD_SIZE &&
         board->size == stats->board_size) {
+      close(legacy_fd);
       return 0;
     }
   }
+  close(legacy_fd);
 
   // Try enhanced format
-  lseek(legacy_fd, 0, SEEK_SET);
-  SaveData save_data;
-  if (read_save_data(filename, &save_data) == 0) {
-    *board = save_data.board;
-    *stats = save_data.stats;
-    *history = save_data.history;
+  if (read_save_data(filename, NULL, board, stats, history) == 0) {
     stats->auto_save = auto_save_enabled;
     return 0;
   }
 
-  if (!auto_save_enabled)
-    close(legacy_fd);
+  if (!auto_save_enabled && lock_fd != -1) {
+    close(lock_fd);
+    lock_fd = -1;
+  }
   return -1;
 }
 
-// Legacy save function (maintains compatibility)
+// Legacy save function (maintains compatibility), safe in signal handlers
 int save_game(const Board *board, const Stats *stats, const History *history) {
-  if (legacy_fd == -1 || !auto_save_enabled)
+  if (lock_fd == -1 || !auto_save_enabled)
     return -1;
 
-  char filename[PATH_LEN];
-  if (get_legacy_filename(filename) == -1)
-    return -1;
+  SaveHeader header;
+  create_header("Auto-save", &header);
 
-  SaveData save_data;
-  create_save_data(board, stats, history, "Auto-save", &save_data);
+  trace_begin("save_game");
+  int result = write_save_data(legacy_filename, legacy_tmp_filename, home_dir,
+                               &header, board, stats, history);
+  trace_end("save_game");
 
-  int result = write_save_data(filename, &save_data);
+  close(lock_fd);
+  lock_fd = -1;
+  return result;
+}
 
-  close(legacy_fd);
-  legacy_fd = -1;
+// Auto-save while playing, keeping the auto-save lock
+int auto_save_game(const Board *board, const Stats *stats,
+                   const History *history) {
+  if (lock_fd == -1 || !auto_save_enabled)
+    return -1;
+
+  SaveHeader header;
+  create_header("Auto-save", &header);
+
+  trace_begin("auto_save_game");
+  int result = write_save_data(legacy_filename, periodic_tmp_filename,
+                               home_dir, &header, board, stats, history);
+  trace_end("auto_save_game");
   return result;
 }
 
@@ -120,14 +270,29 @@ int save_game_slot(const Board *board, const Stats *stats,
   if (init_save_dir() != 0)
     return -1;
 
-  char filename[PATH_LEN];
+  char filename[PATH_LEN], tmp_filename[PATH_LEN + 4];
   if (get_slot_filename(slot, filename) != 0)
     return -1;
+  snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", filename);
 
-  SaveData save_data;
-  create_save_data(board, stats, history, description, &save_data);
+  SaveHeader header;
+  create_header(description, &header);
+
+  trace_begin("save_game_slot");
+  int result = write_save_data(filename, tmp_filename, save_dir, &header,
+                               board, stats, history);
+  trace_end("save_game_slot");
+  if (result != 0)
+    return -1;
 
-  return write_save_data(filename, &save_data);
+  /* Index the new file as it decodes, so the load menu never lists a
+   * slot that doesn't load */
+  SlotEntry entries[MAX_SAVE_SLOTS];
+  read_index(entries);
+  entries[slot].state = SLOT_UNKNOWN;
+  refresh_entry(slot, &entries[slot]);
+  write_index(entries);
+  return entries[slot].state == SLOT_VALID ? 0 : -1;
 }
 
 // Enhanced load function with slot support
@@ -139,42 +304,51 @@ int load_game_slot(Board *board, Stats *stats, History *history, int slot) {
   if (get_slot_filename(slot, filename) != 0)
     return -1;
 
-  SaveData save_data;
-  if (read_save_data(filename, &save_data) != 0)
-    return -1;
-
-  *board = save_data.board;
-  *stats = save_data.stats;
-  *history = save_data.history;
-
-  return 0;
+  trace_begin("load_game_slot");
+  int result = read_save_data(filename, NULL, board, stats, history);
+  trace_end("load_game_slot");
+  return result;
 }
 
 // List all available save slots
 int list_save_slots(char descriptions[MAX_SAVE_SLOTS][64],
                     long timestamps[MAX_SAVE_SLOTS]) {
+  SlotInfo slots[MAX_SAVE_SLOTS];
+
+  int count = list_save_slot_info(slots);
+  if (count < 0)
+    return -1;
+
+  for (int i = 0; i < MAX_SAVE_SLOTS; i++) {
+    memcpy(descriptions[i], slots[i].description, 64);
+    timestamps[i] = slots[i].timestamp;
+  }
+  return count;
+}
+
+// List all save slots from the index, re-reading only changed slots
+int list_save_slot_info(SlotInfo slots[MAX_SAVE_SLOTS]) {
   if (init_save_dir() != 0)
     return -1;
 
+  SlotEntry entries[MAX_SAVE_SLOTS];
+  bool stale = !read_index(entries);
   int count = 0;
 
   for (int i = 0; i < MAX_SAVE_SLOTS; i++) {
-    char filename[PATH_LEN];
-    if (get_slot_filename(i, filename) != 0)
-      continue;
-
-    SaveData save_data;
-    if (read_save_data(filename, &save_data) == 0) {
-      strncpy(descriptions[i], save_data.description, 63);
-      descriptions[i][63] = '\0';
-      timestamps[i] = save_data.timestamp;
+    if (refresh_entry(i, &entries[i]))
+      stale = true;
+
+    if (entries[i].state == SLOT_VALID) {
+      slots[i] = entries[i].info;
       count++;
     } else {
-      descriptions[i][0] = '\0';
-      timestamps[i] = 0;
+      memset(&slots[i], 0, sizeof(SlotInfo));
     }
   }
 
+  if (stale)
+    write_index(entries);
   return count;
 }
 
@@ -187,18 +361,25 @@ int delete_save_slot(int slot) {
   if (get_slot_filename(slot, filename) != 0)
     return -1;
 
-  return unlink(filename);
+  if (unlink(filename) != 0)
+    return -1;
+
+  SlotEntry entries[MAX_SAVE_SLOTS];
+  read_index(entries);
+  memset(&entries[slot], 0, sizeof(SlotEntry));
+  entries[slot].state = SLOT_MISSING;
+  write_index(entries);
+  return 0;
 }
 
 // Get next available slot
 int get_next_available_slot(void) {
-  char descriptions[MAX_SAVE_SLOTS][64];
-  long timestamps[MAX_SAVE_SLOTS];
+  SlotInfo slots[MAX_SAVE_SLOTS];
 
-  list_save_slots(descriptions, timestamps);
+  list_save_slot_info(slots);
 
   for (int i = 0; i < MAX_SAVE_SLOTS; i++) {
-    if (descriptions[i][0] == '\0')
+    if (slots[i].description[0] == '\0')
       return i;
   }
 
@@ -267,8 +448,166 @@ static int get_slot_filename(int slot, char *filename) {
   return 0;
 }
 
+static int get_index_filename(char *filename) {
+  if (init_save_dir() != 0)
+    return -1;
+
+  if (snprintf(filename, PATH_LEN, "%s/index", save_dir) >= PATH_LEN)
+    return -1;
+  return 0;
+}
+
+/* Read the index into 'entries'. Returns false if there's no valid
+ * index, all entries are then SLOT_UNKNOWN */
+static bool read_index(SlotEntry entries[MAX_SAVE_SLOTS]) {
+  char filename[PATH_LEN];
+  const unsigned char *data = NULL;
+  size_t len = 0;
+
+  memset(entries, 0, MAX_SAVE_SLOTS * sizeof(SlotEntry));
+  if (get_index_filename(filename) == 0)
+    data = map_file(filename, &len);
+  if (!data)
+    return false;
+
+  Reader r = {data, data + len - 4, false};
+  bool ok = get_u32(&r) == MAGIC_NUMBER && get_u32(&r) == INDEX_VERSION &&
+            check_crc(data, len) && get_varint(&r) == MAX_SAVE_SLOTS;
+
+  for (int i = 0; ok && i < MAX_SAVE_SLOTS && !r.failed; i++) {
+    SlotEntry *entry = &entries[i];
+    entry->state = get_u8(&r);
+    if (entry->state > SLOT_VALID) {
+      r.failed = true;
+      break;
+    }
+    if (entry->state == SLOT_INVALID || entry->state == SLOT_VALID) {
+      entry->mtime_sec = get_varint(&r);
+      entry->mtime_nsec = get_varint(&r);
+      entry->file_size = get_varint(&r);
+    }
+    if (entry->state == SLOT_VALID) {
+      entry->info.timestamp = get_varint(&r);
+      entry->info.score = get_int(&r);
+      entry->info.board_size = get_u8(&r);
+      size_t desc_len = get_varint(&r);
+      if (desc_len > 63 || desc_len > (size_t)(r.end - r.p)) {
+        r.failed = true;
+        break;
+      }
+      memcpy(entry->info.description, r.p, desc_len);
+      r.p += desc_len;
+    }
+  }
+  munmap((void *)data, len);
+
+  if (!ok || r.failed || r.p != r.end) {
+    memset(entries, 0, MAX_SAVE_SLOTS * sizeof(SlotEntry));
+    return false;
+  }
+  return true;
+}
+
+/* Write the index like a save file, so readers never see half of it */
+static int write_index(const SlotEntry entries[MAX_SAVE_SLOTS]) {
+  char filename[PATH_LEN], tmp_filename[PATH_LEN + 4];
+  Writer w;
+
+  if (get_index_filename(filename) != 0)
+    return -1;
+  snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", filename);
+  if (open_tmp_file(tmp_filename, &w) != 0)
+    return -1;
+
+  put_u32(&w, MAGIC_NUMBER);
+  put_u32(&w, INDEX_VERSION);
+  put_varint(&w, MAX_SAVE_SLOTS);
+  for (int i = 0; i < MAX_SAVE_SLOTS; i++) {
+    const SlotEntry *entry = &entries[i];
+    put_u8(&w, entry->state);
+    if (entry->state == SLOT_INVALID || entry->state == SLOT_VALID) {
+      put_varint(&w, entry->mtime_sec);
+      put_varint(&w, entry->mtime_nsec);
+      put_varint(&w, entry->file_size);
+    }
+    if (entry->state == SLOT_VALID) {
+      size_t desc_len = strlen(entry->info.description);
+      put_varint(&w, entry->info.timestamp);
+      put_varint(&w, entry->info.score);
+      put_u8(&w, entry->info.board_size);
+      put_varint(&w, desc_len);
+      put_bytes(&w, entry->info.description, desc_len);
+    }
+  }
+  return commit_tmp_file(&w, tmp_filename, filename, save_dir);
+}
+
+/* Check the slot file against its index entry and re-read it if it
+ * changed. Returns true if the entry was updated */
+static bool refresh_entry(int slot, SlotEntry *entry) {
+  char filename[PATH_LEN];
+  struct stat st;
+
+  if (get_slot_filename(slot, filename) != 0)
+    return false;
+
+  if (stat(filename, &st) != 0) {
+    if (entry->state == SLOT_MISSING)
+      return false;
+    memset(entry, 0, sizeof(SlotEntry));
+    entry->state = SLOT_MISSING;
+    return true;
+  }
+
+  if ((entry->state == SLOT_VALID || entry->state == SLOT_INVALID) &&
+      entry->mtime_sec == (long)st.st_mtim.tv_sec &&
+      entry->mtime_nsec == (long)st.st_mtim.tv_nsec &&
+      entry->file_size == (long)st.st_size)
+    return false;
+
+  SaveHeader header;
+  Stats stats;
+  memset(entry, 0, sizeof(SlotEntry));
+  set_entry_file(entry, &st);
+  entry->state = SLOT_INVALID;
+  if (read_save_data(filename, &header, NULL, &stats, NULL) == 0) {
+    entry->state = SLOT_VALID;
+    entry->info.timestamp = header.timestamp;
+    entry->info.score = stats.score;
+    entry->info.board_size = stats.board_size;
+    memcpy(entry->info.description, header.description, 64);
+  }
+  return true;
+}
+
+static void set_entry_file(SlotEntry *entry, const struct stat *st) {
+  entry->mtime_sec = st->st_mtim.tv_sec;
+  entry->mtime_nsec = st->st_mtim.tv_nsec;
+  entry->file_size = st->st_size;
+}
+
+/* Map a whole file of 8 to MAX_SAVE_BYTES bytes, to be decoded where
+ * it is. Saves replace files instead of writing into them, so the
+ * mapping stays intact. Returns NULL on error */
+static const unsigned char *map_file(const char *filename, size_t *len) {
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1)
+    return NULL;
+
+  struct stat st;
+  void *data = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size >= 8 && st.st_size <= MAX_SAVE_BYTES)
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (data == MAP_FAILED)
+    return NULL;
+  *len = st.st_size;
+  return data;
+}
+
 static bool validate_save_data(const SaveData *data) {
-  if (data->version != SAVE_VERSION)
+  if (data->version != RAW_VERSION)
     return false;
 
   if (data->stats.score < 0 || data->stats.max_score < 0 ||
@@ -294,63 +633,425 @@ static bool validate_save_data(const SaveData *data) {
   return true;
 }
 
-static int write_save_data(const char *filename, const SaveData *data) {
-  FILE *file = fopen(filename, "wb");
-  if (!file)
+/* Write a save file to 'tmp_filename' in 'dir' and rename it over
+ * 'filename' once it's on disk, so a crash leaves the old file or the
+ * new one. Only async-signal-safe calls are made */
+static int write_save_data(const char *filename, const char *tmp_filename,
+                           const char *dir, const SaveHeader *header,
+                           const Board *board, const Stats *stats,
+                           const History *history) {
+  Writer w;
+  size_t desc_len = strlen(header->description);
+
+  if (open_tmp_file(tmp_filename, &w) != 0)
     return -1;
 
-  // Write magic number for file format identification
-  uint32_t magic = MAGIC_NUMBER;
-  if (fwrite(&magic, sizeof(magic), 1, file) != 1) {
-    fclose(file);
+  put_u32(&w, MAGIC_NUMBER);
+  put_u32(&w, SAVE_VERSION);
+  put_varint(&w, header->timestamp);
+  put_varint(&w, header->play_time);
+  put_varint(&w, desc_len);
+  put_bytes(&w, header->description, desc_len);
+  put_state(&w, board, stats);
+
+  put_varint(&w, history->size);
+  put_varint(&w, history->size > 0 ? history->current : 0);
+  for (int i = 0; i < history->size; i++) {
+    const MoveRecord *move = &history->moves[i];
+    if (move->dir == NO_MOVE) {
+      GameState state;
+      history_state(history, i, &state);
+      put_u8(&w, NO_MOVE);
+      put_state(&w, &state.board, &state.stats);
+    } else {
+      put_u8(&w, move->dir);
+      put_u8(&w, move->tile);
+      put_u8(&w, move->val);
+      put_varint(&w, move->points);
+    }
+  }
+  return commit_tmp_file(&w, tmp_filename, filename, dir);
+}
+
+static int open_tmp_file(const char *tmp_filename, Writer *w) {
+  w->fd =
+      open(tmp_filename, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  w->len = 0;
+  w->written = 0;
+  w->crc = 0;
+  w->failed = false;
+  return w->fd == -1 ? -1 : 0;
+}
+
+/* Append the CRC-32, sync the file, rename it over 'filename' and sync
+ * 'dir' so the rename survives a crash too */
+static int commit_tmp_file(Writer *w, const char *tmp_filename,
+                           const char *filename, const char *dir) {
+  flush(w);
+  put_u32(w, w->crc);
+  flush(w);
+
+  bool ok = !w->failed && fsync(w->fd) == 0;
+  ok = close(w->fd) == 0 && ok;
+  if (!ok || rename(tmp_filename, filename) != 0) {
+    unlink(tmp_filename);
     return -1;
   }
 
-  // Write save data
-  size_t written = fwrite(data, sizeof(SaveData), 1, file);
-  fclose(file);
+  int dir_fd = open(dir, O_RDONLY | O_DIRECTORY);
+  if (dir_fd != -1) {
+    fsync(dir_fd);
+    close(dir_fd);
+  }
+  return 0;
+}
 
-  return (written == 1) ? 0 : -1;
+/* Read any version of save file. 'header', 'board', 'stats' and
+ * 'history' may be NULL if they're not needed, none of them are changed
+ * unless the whole file is valid */
+static int read_save_data(const char *filename, SaveHeader *header,
+                          Board *board, Stats *stats, History *history) {
+  size_t len;
+  const unsigned char *data = map_file(filename, &len);
+  int result = -1;
+
+  if (data) {
+    Reader r = {data, data + len, false};
+    uint32_t magic = get_u32(&r);
+    uint32_t version = get_u32(&r);
+
+    if (magic == MAGIC_NUMBER && version == RAW_VERSION)
+      result = decode_raw(data, len, header, board, stats, history);
+    else if (magic == MAGIC_NUMBER && version == SAVE_VERSION)
+      result = decode(data, len, header, board, stats, history);
+    munmap((void *)data, len);
+  }
+  return result;
 }
 
-static int read_save_data(const char *filename, SaveData *data) {
-  FILE *file = fopen(filename, "rb");
-  if (!file)
-    return -1;
+/* Version 1, the magic number and a SaveData in this machine's layout.
+ * It's copied out as the mapping isn't aligned for it */
+static int decode_raw(const unsigned char *data, size_t len,
+                      SaveHeader *header, Board *board, Stats *stats,
+                      History *history) {
+  SaveData save_data;
 
-  // Read and verify magic number
-  uint32_t magic;
-  if (fread(&magic, sizeof(magic), 1, file) != 1 || magic != MAGIC_NUMBER) {
-    fclose(file);
+  if (len != sizeof(uint32_t) + sizeof(SaveData))
+    return -1;
+  memcpy(&save_data, data + sizeof(uint32_t), sizeof(SaveData));
+  if (!validate_save_data(&save_data))
     return -1;
+
+  if (header) {
+    header->timestamp = save_data.timestamp;
+    header->play_time = save_data.play_time;
+    memcpy(header->description, save_data.description, 64);
+    header->description[63] = '\0';
   }
+  if (board)
+    *board = save_data.board;
+  if (stats)
+    *stats = save_data.stats;
+  if (history)
+    history_import(history, &save_data.history);
+  return 0;
+}
+
+static int decode(const unsigned char *data, size_t len, SaveHeader *header,
+                  Board *board, Stats *stats, History *history) {
+  Reader r = {data + 8, data + len - 4, false};
+  SaveHeader h;
+  Board b;
+  Stats s;
 
-  // Read save data
-  size_t read_bytes = fread(data, sizeof(SaveData), 1, file);
-  fclose(file);
+  if (!check_crc(data, len))
+    return -1;
 
-  if (read_bytes != 1 || !validate_save_data(data))
+  h.timestamp = get_varint(&r);
+  h.play_time = get_int(&r);
+  size_t desc_len = get_varint(&r);
+  if (desc_len > 63 || desc_len > (size_t)(r.end - r.p))
+    return -1;
+  memcpy(h.description, r.p, desc_len);
+  h.description[desc_len] = '\0';
+  r.p += desc_len;
+  get_state(&r, &b, &s);
+
+  /* check every history state even if the history isn't wanted, moves
+   * replayed, so a slot is listed only if it loads */
+  int size = get_int(&r);
+  int current = get_int(&r);
+  if (r.failed || size > r.end - r.p || current >= size ||
+      (size == 0 && current != 0))
+    return -1;
+  Reader history_start = r;
+  if (!get_history(&r, size, b.size, NULL) || r.p != r.end)
     return -1;
 
+  if (header)
+    *header = h;
+  if (board)
+    *board = b;
+  if (stats)
+    *stats = s;
+  if (history) {
+    /* every move was replayed above, so decode straight into 'history' */
+    history_clear(history);
+    get_history(&history_start, size, b.size, history);
+    if (size > 0)
+      history_seek(history, current);
+  }
   return 0;
 }
 
-static void create_save_data(const Board *board, const Stats *stats,
-                             const History *history, const char *description,
-                             SaveData *save_data) {
-  memset(save_data, 0, sizeof(SaveData));
+/* Decode 'size' history states into 'history', or only check them if
+ * it's NULL. Returns false if they're not valid */
+static bool get_history(Reader *r, int size, int board_size,
+                        History *history) {
+  Board board; /* newest state's, moves are replayed on it */
+
+  for (int i = 0; i < size && !r->failed; i++) {
+    if (get_u8(r) == NO_MOVE) {
+      GameState state;
+      get_state(r, &state.board, &state.stats);
+      if (!r->failed && state.board.size != board_size)
+        r->failed = true;
+      if (!r->failed)
+        board = state.board;
+      if (!r->failed && history)
+        history_save_state(history, &state.board, &state.stats);
+    } else {
+      MoveRecord move;
+      r->p--;
+      get_move(r, board_size, &move);
+      if (!r->failed && (i == 0 || !play_move(&board, &move)))
+        r->failed = true;
+      if (!r->failed && history && !history_append_move(history, &move))
+        r->failed = true;
+    }
+  }
+  return !r->failed;
+}
 
-  save_data->version = SAVE_VERSION;
-  save_data->timestamp = time(NULL);
-  save_data->play_time = 0; // TODO: implement play time tracking
-  save_data->board = *board;
-  save_data->stats = *stats;
-  save_data->history = *history;
+static void create_header(const char *description, SaveHeader *header) {
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  header->timestamp = now.tv_sec;
+  header->play_time = 0; // TODO: implement play time tracking
 
   if (description) {
-    strncpy(save_data->description, description, 63);
-    save_data->description[63] = '\0';
+    strncpy(header->description, description, 63);
+    header->description[63] = '\0';
   } else {
-    strcpy(save_data->description, "Game Save");
+    strcpy(header->description, "Game Save");
+  }
+}
+
+/* Write out the buffer, adding it to the CRC-32 past the magic number */
+static void flush(Writer *w) {
+  size_t skip = w->written < 4 ? 4 - w->written : 0;
+  if (skip > w->len)
+    skip = w->len;
+  w->crc = crc32(w->crc, w->buf + skip, w->len - skip);
+
+  for (size_t done = 0; done < w->len && !w->failed;) {
+    ssize_t n = write(w->fd, w->buf + done, w->len - done);
+    if (n > 0)
+      done += n;
+    else if (n == -1 && errno != EINTR)
+      w->failed = true;
+  }
+  w->written += w->len;
+  w->len = 0;
+}
+
+static void put_bytes(Writer *w, const void *bytes, size_t n) {
+  const unsigned char *p = bytes;
+
+  while (n > 0) {
+    if (w->len == sizeof(w->buf))
+      flush(w);
+    size_t chunk = sizeof(w->buf) - w->len;
+    if (chunk > n)
+      chunk = n;
+    memcpy(w->buf + w->len, p, chunk);
+    w->len += chunk;
+    p += chunk;
+    n -= chunk;
+  }
+}
+
+static void put_u8(Writer *w, unsigned v) {
+  unsigned char byte = v;
+  put_bytes(w, &byte, 1);
+}
+
+static void put_u32(Writer *w, uint32_t v) {
+  unsigned char bytes[4] = {v, v >> 8, v >> 16, v >> 24};
+  put_bytes(w, bytes, 4);
+}
+
+/* 7 bits per byte, low bits first, high bit set on all but the last */
+static void put_varint(Writer *w, uint64_t v) {
+  unsigned char bytes[10];
+  int n = 0;
+
+  while (v >= 0x80) {
+    bytes[n++] = (v & 0x7F) | 0x80;
+    v >>= 7;
+  }
+  bytes[n++] = v;
+  put_bytes(w, bytes, n);
+}
+
+static void put_state(Writer *w, const Board *board, const Stats *stats) {
+  unsigned char packed[(MAX_BOARD_TILES * 5 + 7) / 8] = {0};
+  int bit = 0;
+
+  put_u8(w, board->size);
+  put_varint(w, stats->score);
+  put_varint(w, stats->max_score);
+  /* NO_SLIDE after a key that didn't slide, points are transient */
+  put_varint(w, stats->points > 0 ? stats->points : 0);
+  put_u8(w, stats->game_over | stats->auto_save << 1);
+
+  for (int y = 0; y < board->size; y++) {
+    for (int x = 0; x < board->size; x++, bit += 5) {
+      unsigned v = (unsigned)board->tiles[y][x] << (bit % 8);
+      packed[bit / 8] |= v;
+      if (v >> 8)
+        packed[bit / 8 + 1] |= v >> 8;
+    }
+  }
+  put_bytes(w, packed, (bit + 7) / 8);
+}
+
+static unsigned get_u8(Reader *r) {
+  if (r->p >= r->end) {
+    r->failed = true;
+    return 0;
   }
+  return *r->p++;
+}
+
+static uint32_t get_u32(Reader *r) {
+  uint32_t v = 0;
+  for (int i = 0; i < 4; i++)
+    v |= (uint32_t)get_u8(r) << (i * 8);
+  return v;
+}
+
+static uint64_t get_varint(Reader *r) {
+  uint64_t v = 0;
+
+  for (int shift = 0; shift < 64; shift += 7) {
+    unsigned byte = get_u8(r);
+    v |= (uint64_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80))
+      return v;
+  }
+  r->failed = true;
+  return 0;
+}
+
+/* Varint that must fit a non-negative int */
+static int get_int(Reader *r) {
+  uint64_t v = get_varint(r);
+  if (v > INT_MAX) {
+    r->failed = true;
+    return 0;
+  }
+  return v;
+}
+
+static void get_state(Reader *r, Board *board, Stats *stats) {
+  int size = get_u8(r);
+  if (size < MIN_BOARD_SIZE || size > MAX_BOARD_SIZE) {
+    r->failed = true;
+    return;
+  }
+
+  memset(board, 0, sizeof(Board));
+  memset(stats, 0, sizeof(Stats));
+  board->size = size;
+  stats->board_size = size;
+  stats->score = get_int(r);
+  stats->max_score = get_int(r);
+  /* earlier saves wrote a blocked slide's NO_SLIDE as a huge varint */
+  uint64_t points = get_varint(r);
+  stats->points = points <= INT_MAX ? (int)points : 0;
+  unsigned flags = get_u8(r);
+  stats->game_over = flags & 1;
+  stats->auto_save = flags & 2;
+
+  int bytes = (size * size * 5 + 7) / 8;
+  if (flags > 3 || bytes > r->end - r->p) {
+    r->failed = true;
+    return;
+  }
+  for (int i = 0, bit = 0; i < size * size; i++, bit += 5) {
+    unsigned v = r->p[bit / 8] >> (bit % 8);
+    if (bit % 8 > 3)
+      v |= r->p[bit / 8 + 1] << (8 - bit % 8);
+    v &= 0x1F;
+    if (v > MAX_TILE)
+      r->failed = true;
+    board->tiles[i / size][i % size] = v;
+  }
+  r->p += bytes;
+}
+
+static void get_move(Reader *r, int size, MoveRecord *move) {
+  move->dir = get_u8(r);
+  move->tile = get_u8(r);
+  move->val = get_u8(r);
+  move->points = get_int(r);
+
+  if (move->dir > RIGHT ||
+      (move->tile != NO_MOVE &&
+       (move->tile >= size * size || move->val < 1 || move->val > MAX_TILE)))
+    r->failed = true;
+}
+
+/* Make 'move' on 'board'. Returns false if it doesn't slide or its tile
+ * lands on another, as replay_play() rejects */
+static bool play_move(Board *board, const MoveRecord *move) {
+  Board new_board;
+  int size = board->size;
+
+  if (board_slide(board, &new_board, NULL, move->dir) == NO_SLIDE)
+    return false;
+  if (move->tile != NO_MOVE) {
+    int *tile = &new_board.tiles[move->tile / size][move->tile % size];
+    if (*tile != 0)
+      return false;
+    *tile = move->val;
+  }
+  *board = new_board;
+  return true;
+}
+
+/* Continue the CRC-32 'crc' of earlier data, 0 to start */
+static uint32_t crc32(uint32_t crc, const unsigned char *data, size_t len) {
+  static uint32_t table[256];
+
+  if (!table[1]) {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++)
+        c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+      table[i] = c;
+    }
+  }
+
+  crc ^= 0xFFFFFFFF;
+  for (size_t i = 0; i < len; i++)
+    crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  return crc ^ 0xFFFFFFFF;
+}
+
+/* Check the CRC-32 at the end of a file of at least 8 bytes */
+static bool check_crc(const unsigned char *data, size_t len) {
+  Reader r = {data + len - 4, data + len, false};
+  return get_u32(&r) == crc32(0, data + 4, len - 8);
 }
@@ -9,14 +9,29 @@
 int load_game(Board *board, Stats *stats, History *history);
 int save_game(const Board *board, const Stats *stats, const History *history);
 
-/* Manual save/load functions with multiple slots */
+/* Auto-save without giving up auto-saving, like save_game() does */
+int auto_save_game(const Board *board, const Stats *stats,
+                   const History *history);
+
+/* Manual save/load functions with multiple slots. save_game_slot()
+ * reads the file back and returns -1 unless it loads */
 int save_game_slot(const Board *board, const Stats *stats,
                    const History *history, int slot, const char *description);
 int load_game_slot(Board *board, Stats *stats, History *history, int slot);
 
-/* Save file management */
+/* What the load menu shows of a slot */
+typedef struct slot_info {
+  char description[64]; /* empty if the slot has no valid save */
+  long timestamp;
+  int score;
+  int board_size;
+} SlotInfo;
+
+/* Save file management. Slots are listed from an index file, only
+ * slot files changed since it was written are read */
 int list_save_slots(char descriptions[MAX_SAVE_SLOTS][64],
                     long timestamps[MAX_SAVE_SLOTS]);
+int list_save_slot_info(SlotInfo slots[MAX_SAVE_SLOTS]);
 int delete_save_slot(int slot);
 int get_next_available_slot(void);
 
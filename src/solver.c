@@ -0,0 +1,471 @@
+#include "solver.h"
+#include "bitboard.h"
+#include "board.h"
+#include "rowtable.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Heuristic weights, per row and column */
+#define LOST_PENALTY 200000.0
+#define EMPTY_WEIGHT 270.0
+#define MERGES_WEIGHT 700.0
+#define MONOTONICITY_POWER 4.0
+#define MONOTONICITY_WEIGHT 47.0
+#define SUM_POWER 3.5
+#define SUM_WEIGHT 11.0
+
+/* Chance nodes this unlikely are evaluated instead of searched */
+#define PROB_CUTOFF 0.0001
+#define MAX_DEPTH 12
+
+/* Transposition table, keyed by the board's Zobrist hash */
+#define TT_BITS 20
+#define TT_SIZE (1 << TT_BITS)
+
+#define MAX_THREADS 64
+
+/* Shared by all search threads without locks. 'check' holds the key
+ * xor'ed with 'data', so a torn entry from two racing writers fails the
+ * key test and is treated as a miss */
+typedef struct tt_entry {
+  _Atomic uint64_t check;
+  _Atomic uint64_t data; /* value bits in the low half, depth above */
+} TTEntry;
+
+typedef struct search {
+  long nodes;
+} Search;
+
+/* One spawn after one root direction, searched by any pool thread */
+typedef struct task {
+  Board board;
+  Dir dir;
+  double weight; /* chance of the spawn */
+  double value;
+} Task;
+
+/* Workers wait for a new 'generation' of tasks, the caller of
+ * solver_best_move() works on the same batch and waits for 'busy' to
+ * drop to zero */
+static struct pool {
+  pthread_t threads[MAX_THREADS];
+  int threads_n; /* including the searching thread */
+  bool started;
+  pthread_mutex_t lock;
+  pthread_cond_t work;
+  pthread_cond_t done;
+  unsigned generation;
+  int busy;
+  Task tasks[4 * MAX_BOARD_TILES * 2];
+  int tasks_n;
+  atomic_int next_task;
+  int depth;
+} pool = {.lock = PTHREAD_MUTEX_INITIALIZER,
+          .work = PTHREAD_COND_INITIALIZER,
+          .done = PTHREAD_COND_INITIALIZER};
+
+/* Heuristic for every row of 3, 4 and 5 cells, keyed like row_table() */
+static float heur_3[TILE_VALUES * TILE_VALUES * TILE_VALUES];
+static float heur_4[TILE_VALUES * TILE_VALUES * TILE_VALUES * TILE_VALUES];
+static float heur_5[TILE_VALUES * TILE_VALUES * TILE_VALUES * TILE_VALUES *
+                    TILE_VALUES];
+static bool heur_ready[MAX_BOARD_SIZE + 1];
+/* Value of a lost board, below any board's heuristic: late-game lines
+ * go negative, 0 would rank a dead end above them */
+static double heur_lost[MAX_BOARD_SIZE + 1];
+
+static uint64_t zobrist[MAX_BOARD_TILES][TILE_VALUES];
+static bool zobrist_ready = false;
+
+static TTEntry tt[TT_SIZE];
+static int last_depth = 0;
+static struct timespec deadline;
+static atomic_bool aborted;
+
+static void init_tables(int size);
+static void start_pool(void);
+static void *worker(void *arg);
+static void run_tasks(void);
+static const float *heur_table(int size);
+static double line_heur(const int *line, int size);
+static double board_heur(const Board *board, const float *heur);
+static uint64_t board_hash(const Board *board);
+static bool out_of_time(void);
+static double search_max(Search *s, const Board *board, int depth,
+                         double prob);
+static double search_chance(Search *s, const Board *board, int depth,
+                            double prob);
+
+void solver_set_threads(int threads) {
+  if (pool.started)
+    return;
+  if (threads <= 0)
+    threads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (threads < 1)
+    threads = 1;
+  if (threads > MAX_THREADS)
+    threads = MAX_THREADS;
+  pool.threads_n = threads;
+}
+
+bool solver_best_move(const Board *board, int budget_ms, Dir *dir) {
+  Board moved[4];
+  bool slides[4];
+  Dir best_dir = LEFT;
+  bool found = false;
+
+  init_tables(board->size);
+  start_pool();
+
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += budget_ms / 1000;
+  deadline.tv_nsec += (budget_ms % 1000) * 1000000L;
+  if (deadline.tv_nsec >= 1000000000L) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+  atomic_store(&aborted, false);
+
+  /* one task per root direction and spawn, depth 1 needs no spawns */
+  pool.tasks_n = 0;
+  for (Dir d = UP; d <= RIGHT; d++) {
+    slides[d] = board_slide(board, &moved[d], NULL, d) != NO_SLIDE;
+    if (!slides[d])
+      continue;
+    found = true;
+
+    int empty = __builtin_popcount(board_empty_mask(&moved[d]));
+    for (int y = 0; y < board->size; y++) {
+      for (int x = 0; x < board->size; x++) {
+        if (moved[d].tiles[y][x] != 0)
+          continue;
+        for (int val = 1; val <= 2; val++) {
+          Task *task = &pool.tasks[pool.tasks_n++];
+          task->board = moved[d];
+          task->board.tiles[y][x] = val;
+          task->dir = d;
+          task->weight = (val == 1 ? 0.9 : 0.1) / empty;
+        }
+      }
+    }
+  }
+  if (!found)
+    return false; /* no direction slides */
+
+  last_depth = 0;
+  /* iterative deepening, keep the result of the last full iteration */
+  for (int depth = 1; depth <= MAX_DEPTH; depth++) {
+    double values[4] = {-INFINITY, -INFINITY, -INFINITY, -INFINITY};
+
+    if (depth == 1) {
+      for (Dir d = UP; d <= RIGHT; d++) {
+        if (slides[d])
+          values[d] = board_heur(&moved[d], heur_table(board->size));
+      }
+    } else {
+      pool.depth = depth - 1;
+      run_tasks();
+      if (atomic_load(&aborted))
+        break;
+      for (Dir d = UP; d <= RIGHT; d++) {
+        if (slides[d])
+          values[d] = 0;
+      }
+      for (int i = 0; i < pool.tasks_n; i++) {
+        Task *task = &pool.tasks[i];
+        values[task->dir] += task->weight * task->value;
+      }
+    }
+
+    double best = -INFINITY;
+    for (Dir d = UP; d <= RIGHT; d++) {
+      if (values[d] > best) {
+        best = values[d];
+        best_dir = d;
+      }
+    }
+
+    last_depth = depth;
+    if (out_of_time())
+      break;
+  }
+
+  *dir = best_dir;
+  return true;
+}
+
+int solver_last_depth(void) { return last_depth; }
+
+/* Lazily built tables must be ready before threads share them */
+static void init_tables(int size) {
+  bitboard_init();
+  row_table(size);
+  heur_table(size);
+  board_hash(&(Board){.size = size});
+}
+
+static void start_pool(void) {
+  if (pool.started)
+    return;
+  if (pool.threads_n == 0)
+    solver_set_threads(0);
+
+  for (int i = 1; i < pool.threads_n; i++) {
+    if (pthread_create(&pool.threads[i], NULL, worker, NULL) != 0) {
+      pool.threads_n = i; /* search with the threads we got */
+      break;
+    }
+  }
+  pool.started = true;
+}
+
+static void *worker(void *arg) {
+  (void)arg;
+  unsigned seen = 0;
+
+  while (1) {
+    pthread_mutex_lock(&pool.lock);
+    while (pool.generation == seen)
+      pthread_cond_wait(&pool.work, &pool.lock);
+    seen = pool.generation;
+    pthread_mutex_unlock(&pool.lock);
+
+    Search s = {.nodes = 0};
+    int i;
+    while ((i = atomic_fetch_add(&pool.next_task, 1)) < pool.tasks_n) {
+      Task *task = &pool.tasks[i];
+      task->value = search_max(&s, &task->board, pool.depth, task->weight);
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    if (--pool.busy == 0)
+      pthread_cond_signal(&pool.done);
+    pthread_mutex_unlock(&pool.lock);
+  }
+  return NULL;
+}
+
+/* Search all tasks at 'pool.depth' on every pool thread */
+static void run_tasks(void) {
+  atomic_store(&pool.next_task, 0);
+
+  pthread_mutex_lock(&pool.lock);
+  pool.busy = pool.threads_n - 1;
+  pool.generation++;
+  pthread_cond_broadcast(&pool.work);
+  pthread_mutex_unlock(&pool.lock);
+
+  Search s = {.nodes = 0};
+  int i;
+  while ((i = atomic_fetch_add(&pool.next_task, 1)) < pool.tasks_n) {
+    Task *task = &pool.tasks[i];
+    task->value = search_max(&s, &task->board, pool.depth, task->weight);
+  }
+
+  pthread_mutex_lock(&pool.lock);
+  while (pool.busy > 0)
+    pthread_cond_wait(&pool.done, &pool.lock);
+  pthread_mutex_unlock(&pool.lock);
+}
+
+static double search_max(Search *s, const Board *board, int depth,
+                         double prob) {
+  double best = heur_lost[board->size];
+
+  for (Dir d = UP; d <= RIGHT; d++) {
+    Board new_board;
+    if (board_slide(board, &new_board, NULL, d) == NO_SLIDE)
+      continue;
+    double value = search_chance(s, &new_board, depth, prob);
+    if (value > best)
+      best = value;
+  }
+
+  return best;
+}
+
+/* Average over every spawn board_add_tile() can make: a '2' with 90%
+ * chance or a '4' with 10% chance, in any empty tile */
+static double search_chance(Search *s, const Board *board, int depth,
+                            double prob) {
+  if (depth <= 1 || prob < PROB_CUTOFF)
+    return board_heur(board, heur_table(board->size));
+
+  if ((++s->nodes & 0xFF) == 0 && out_of_time())
+    atomic_store_explicit(&aborted, true, memory_order_relaxed);
+  if (atomic_load_explicit(&aborted, memory_order_relaxed))
+    return 0;
+
+  uint64_t key = board_hash(board);
+  TTEntry *entry = &tt[key & (TT_SIZE - 1)];
+  uint64_t data = atomic_load_explicit(&entry->data, memory_order_relaxed);
+  uint64_t check = atomic_load_explicit(&entry->check, memory_order_relaxed);
+  if ((check ^ data) == key && (int)(data >> 32) >= depth) {
+    float value;
+    uint32_t bits = (uint32_t)data;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+  int empty = __builtin_popcount(board_empty_mask(board));
+
+  double sum = 0;
+  Board next = *board;
+  for (int y = 0; y < board->size; y++) {
+    for (int x = 0; x < board->size; x++) {
+      if (board->tiles[y][x] != 0)
+        continue;
+      next.tiles[y][x] = 1;
+      sum += 0.9 * search_max(s, &next, depth - 1, prob * 0.9 / empty);
+      next.tiles[y][x] = 2;
+      sum += 0.1 * search_max(s, &next, depth - 1, prob * 0.1 / empty);
+      next.tiles[y][x] = 0;
+    }
+  }
+  double value = sum / empty;
+
+  if (!atomic_load_explicit(&aborted, memory_order_relaxed)) {
+    float stored = value;
+    uint32_t bits;
+    memcpy(&bits, &stored, sizeof(bits));
+    data = (uint64_t)depth << 32 | bits;
+    atomic_store_explicit(&entry->data, data, memory_order_relaxed);
+    atomic_store_explicit(&entry->check, key ^ data, memory_order_relaxed);
+  }
+  return value;
+}
+
+static bool out_of_time(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec > deadline.tv_sec ||
+         (now.tv_sec == deadline.tv_sec && now.tv_nsec >= deadline.tv_nsec);
+}
+
+static double board_heur(const Board *board, const float *heur) {
+  int size = board->size;
+  double value = 0;
+
+  for (int i = 0; i < size; i++) {
+    int column[MAX_BOARD_SIZE];
+    for (int j = 0; j < size; j++)
+      column[j] = board->tiles[j][i];
+    value += heur[row_key(board->tiles[i], size)];
+    value += heur[row_key(column, size)];
+  }
+
+  return value;
+}
+
+static const float *heur_table(int size) {
+  float *table;
+
+  switch (size) {
+  case 3:
+    table = heur_3;
+    break;
+  case 4:
+    table = heur_4;
+    break;
+  default:
+    table = heur_5;
+    size = 5;
+    break;
+  }
+
+  if (heur_ready[size])
+    return table;
+
+  int rows = 1;
+  for (int i = 0; i < size; i++)
+    rows *= TILE_VALUES;
+
+  int line[MAX_BOARD_SIZE] = {0};
+  double min = INFINITY;
+  for (int key = 0; key < rows; key++) {
+    table[key] = line_heur(line, size);
+    if (table[key] < min)
+      min = table[key];
+
+    /* next line: increment the base TILE_VALUES counter */
+    for (int i = 0; i < size && ++line[i] == TILE_VALUES; i++)
+      line[i] = 0;
+  }
+
+  /* a board's value is the sum of its rows' and columns' */
+  heur_lost[size] = 2 * size * min - LOST_PENALTY;
+  heur_ready[size] = true;
+  return table;
+}
+
+/* Rewards empty tiles and pending merges, penalizes lines that aren't
+ * monotonic and large tiles in general */
+static double line_heur(const int *line, int size) {
+  double sum = 0;
+  int empty = 0;
+  int merges = 0;
+  int prev = 0;
+  int counter = 0;
+
+  for (int i = 0; i < size; i++) {
+    int rank = line[i];
+    sum += pow(rank, SUM_POWER);
+    if (rank == 0) {
+      empty++;
+    } else {
+      if (prev == rank) {
+        counter++;
+      } else if (counter > 0) {
+        merges += 1 + counter;
+        counter = 0;
+      }
+      prev = rank;
+    }
+  }
+  if (counter > 0)
+    merges += 1 + counter;
+
+  double mono_left = 0;
+  double mono_right = 0;
+  for (int i = 1; i < size; i++) {
+    double l = pow(line[i - 1], MONOTONICITY_POWER);
+    double r = pow(line[i], MONOTONICITY_POWER);
+    if (line[i - 1] > line[i])
+      mono_left += l - r;
+    else
+      mono_right += r - l;
+  }
+
+  return LOST_PENALTY + EMPTY_WEIGHT * empty + MERGES_WEIGHT * merges -
+         MONOTONICITY_WEIGHT * fmin(mono_left, mono_right) -
+         SUM_WEIGHT * sum;
+}
+
+static uint64_t board_hash(const Board *board) {
+  if (!zobrist_ready) {
+    /* splitmix64 from a fixed seed */
+    uint64_t state = 0x2048;
+    for (int i = 0; i < MAX_BOARD_TILES; i++) {
+      for (int v = 0; v < TILE_VALUES; v++) {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        zobrist[i][v] = z ^ (z >> 31);
+      }
+    }
+    zobrist_ready = true;
+  }
+
+  uint64_t hash = board->size;
+  for (int y = 0; y < board->size; y++) {
+    for (int x = 0; x < board->size; x++)
+      hash ^= zobrist[y * MAX_BOARD_SIZE + x][board->tiles[y][x]];
+  }
+  return hash;
+}
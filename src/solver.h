@@ -0,0 +1,21 @@
+#ifndef SOLVER_H
+#define SOLVER_H
+
+#include "common.h"
+
+/* Per-move search budget used by the hint and autoplay keys */
+#define SOLVER_BUDGET_MS 10
+
+/* Number of threads searching in parallel, 0 for one per online CPU
+ * (the default). Has no effect once the first search started */
+void solver_set_threads(int threads);
+
+/* Pick the best direction with an expectimax search over tile spawns,
+ * deepening until 'budget_ms' runs out.
+ * Returns false if the board can't slide in any direction */
+bool solver_best_move(const Board *board, int budget_ms, Dir *dir);
+
+/* Depth reached by the last completed iteration of the last search */
+int solver_last_depth(void);
+
+#endif
@@ -0,0 +1,211 @@
+#include "trace.h"
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TRACE_THREADS 64
+#define TRACE_EVENTS (1 << 16) /* per thread */
+
+typedef struct event {
+  const char *name;
+  uint64_t ns; /* since trace_start() */
+  char phase;
+} Event;
+
+/* Written by its thread only. Read by trace_stop() once the others are
+ * idle: the solver pool between searches, the autosave writer stopped
+ * or halted, batch workers joined */
+typedef struct buffer {
+  Event events[TRACE_EVENTS];
+  int n;
+  int depth;    /* begun and not ended */
+  int skipping; /* begins dropped, their ends must be too */
+  long dropped;
+} Buffer;
+
+bool trace_enabled = false;
+
+/* All threads' buffers, allocated at once. Pages never touched by a
+ * thread cost nothing */
+static Buffer *buffers;
+static atomic_int buffers_n;
+static _Thread_local Buffer *thread_buffer;
+static _Thread_local bool thread_claimed;
+/* The file is written through a fixed buffer, so trace_stop() needs no
+ * malloc() or stdio and works in a signal handler */
+static struct output {
+  int fd;
+  char buf[4096];
+  size_t len;
+  bool failed;
+} out = {.fd = -1};
+static const char *file_name;
+static uint64_t start_ns;
+
+static Buffer *claim_buffer(void);
+static uint64_t now_ns(void);
+static void put_text(const char *text);
+static void put_uint(uint64_t n, int min_digits);
+static void flush_out(void);
+
+int trace_start(const char *filename) {
+  buffers = calloc(TRACE_THREADS, sizeof(Buffer));
+  out.fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (!buffers || out.fd == -1) {
+    free(buffers);
+    if (out.fd != -1)
+      close(out.fd);
+    out.fd = -1;
+    return -1;
+  }
+
+  file_name = filename;
+  start_ns = now_ns();
+  atexit(trace_stop);
+  trace_enabled = true;
+  return 0;
+}
+
+void trace_stop(void) {
+  if (!trace_enabled)
+    return;
+  trace_enabled = false;
+
+  pid_t pid = getpid();
+  int threads_n = atomic_load(&buffers_n);
+  long dropped = 0;
+  bool first = true;
+
+  if (threads_n > TRACE_THREADS)
+    threads_n = TRACE_THREADS;
+  put_text("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  for (int t = 0; t < threads_n; t++) {
+    const Buffer *b = &buffers[t];
+    for (int i = 0; i < b->n; i++) {
+      const Event *e = &b->events[i];
+      char phase[2] = {e->phase, '\0'};
+
+      put_text(first ? "\n{\"name\":\"" : ",\n{\"name\":\"");
+      put_text(e->name);
+      put_text("\",\"ph\":\"");
+      put_text(phase);
+      put_text("\",\"ts\":");
+      put_uint(e->ns / 1000, 1);
+      put_text(".");
+      put_uint(e->ns % 1000, 3);
+      put_text(",\"pid\":");
+      put_uint(pid, 1);
+      put_text(",\"tid\":");
+      put_uint(t + 1, 1);
+      put_text("}");
+      first = false;
+    }
+    dropped += b->dropped;
+  }
+  put_text("\n]}\n");
+  flush_out();
+
+  bool failed = close(out.fd) != 0 || out.failed;
+  out.fd = STDERR_FILENO;
+  out.failed = false;
+  if (failed) {
+    put_text("trace: can't write '");
+    put_text(file_name);
+    put_text("'\n");
+  }
+  if (dropped > 0) {
+    put_text("trace: ");
+    put_uint(dropped, 1);
+    put_text(" events dropped, buffers full\n");
+  }
+  flush_out();
+}
+
+/* Events are dropped rather than unbalanced: a begin is only kept while
+ * there's room left to end everything begun */
+void trace_event(const char *name, char phase) {
+  Buffer *b = thread_buffer ? thread_buffer : claim_buffer();
+  if (!b)
+    return;
+
+  if (phase == 'B') {
+    if (b->skipping > 0 || b->n + b->depth + 1 >= TRACE_EVENTS) {
+      b->skipping++;
+      b->dropped++;
+      return;
+    }
+    b->depth++;
+  } else if (b->skipping > 0) {
+    b->skipping--;
+    b->dropped++;
+    return;
+  } else if (b->depth > 0) {
+    b->depth--;
+  } else if (b->n == TRACE_EVENTS) {
+    b->dropped++; /* an end of nothing begun, the buffer's full */
+    return;
+  }
+
+  Event *e = &b->events[b->n++];
+  e->name = name;
+  e->phase = phase;
+  e->ns = now_ns() - start_ns;
+}
+
+/* The calling thread's buffer, NULL once all are taken */
+static Buffer *claim_buffer(void) {
+  if (thread_claimed)
+    return NULL;
+  thread_claimed = true;
+
+  int i = atomic_fetch_add(&buffers_n, 1);
+  if (i >= TRACE_THREADS)
+    return NULL;
+  thread_buffer = &buffers[i];
+  return thread_buffer;
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void put_text(const char *text) {
+  size_t len = strlen(text);
+
+  if (out.len + len > sizeof(out.buf))
+    flush_out();
+  if (len > sizeof(out.buf))
+    len = sizeof(out.buf); /* names are short, never happens */
+  memcpy(out.buf + out.len, text, len);
+  out.len += len;
+}
+
+/* Decimal 'n', zero padded to 'min_digits' */
+static void put_uint(uint64_t n, int min_digits) {
+  char digits[24];
+  int i = sizeof(digits) - 1;
+
+  digits[i] = '\0';
+  do {
+    digits[--i] = '0' + n % 10;
+    n /= 10;
+  } while (n > 0 || (int)sizeof(digits) - 1 - i < min_digits);
+  put_text(digits + i);
+}
+
+static void flush_out(void) {
+  for (size_t done = 0; done < out.len && !out.failed;) {
+    ssize_t n = write(out.fd, out.buf + done, out.len - done);
+    if (n <= 0)
+      out.failed = true;
+    else
+      done += n;
+  }
+  out.len = 0;
+}
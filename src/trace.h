@@ -0,0 +1,35 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+
+/* Opt-in tracing of hot-path phases as Chrome Trace Event JSON, for
+ * chrome://tracing or Perfetto. Every thread records begin and end
+ * events into its own fixed buffer, without locks or allocations, and
+ * the file is written on exit. Events past a full buffer are dropped */
+
+extern bool trace_enabled;
+
+/* Trace from now on, writing 'filename' on exit. Returns -1 if the file
+ * can't be created */
+int trace_start(const char *filename);
+
+/* Write the trace and stop tracing, done by exit(). Other threads must
+ * be idle. Async-signal-safe, for a signal handler to call before it
+ * exits */
+void trace_stop(void);
+
+void trace_event(const char *name, char phase);
+
+/* 'name' must be a string constant, only the pointer is kept */
+static inline void trace_begin(const char *name) {
+  if (trace_enabled)
+    trace_event(name, 'B');
+}
+
+static inline void trace_end(const char *name) {
+  if (trace_enabled)
+    trace_event(name, 'E');
+}
+
+#endif